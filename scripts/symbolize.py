@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+
+# symbolize the output of `profile_dump` against the kernel ELF.
+#
+# > ./symbolize.py build/src/kernel8.elf < qemu.log
+#
+# samples are grouped by function. `--by-pid` additionally splits them by
+# process and container.
+
+import re
+import sys
+from bisect import bisect_right
+from collections import Counter
+from argparse import ArgumentParser
+from subprocess import check_output
+
+sample_pattern = re.compile(
+    r'sample pc=0x([0-9a-f]+) pid=(\d+) container=(\d+) cpu=(\d+) count=(\d+)')
+
+def load_symbols(elf, nm):
+    addresses, names = [], []
+    output = check_output([nm, '-n', '--defined-only', elf], text=True)
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[1] in 'tTwW':
+            addresses.append(int(fields[0], 16))
+            names.append(fields[2])
+    return addresses, names
+
+def symbolize(pc, addresses, names):
+    i = bisect_right(addresses, pc) - 1
+    if i < 0:
+        return f'0x{pc:x}'
+    return names[i]
+
+if __name__ == '__main__':
+    parser = ArgumentParser()
+    parser.add_argument('elf')
+    parser.add_argument('--nm', default='aarch64-linux-gnu-nm')
+    parser.add_argument('--by-pid', action='store_true')
+    args = parser.parse_args()
+
+    addresses, names = load_symbols(args.elf, args.nm)
+
+    counts = Counter()
+    for line in sys.stdin:
+        match = sample_pattern.search(line)
+        if not match:
+            continue
+        pc, pid, cont, _, count = match.groups()
+        pc = int(pc, 16)
+
+        # user programs are mapped at low addresses.
+        name = symbolize(pc, addresses, names) if pc >> 48 else f'(user) 0x{pc:x}'
+        key = (name, pid, cont) if args.by_pid else (name,)
+        counts[key] += int(count)
+
+    total = sum(counts.values())
+    for key, count in counts.most_common():
+        extra = f'  pid={key[1]} container={key[2]}' if args.by_pid else ''
+        print(f'{100 * count / total:6.2f}% {count:8d}  {key[0]}{extra}')
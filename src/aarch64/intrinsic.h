@@ -27,6 +27,15 @@ static ALWAYS_INLINE u64 get_timestamp() {
     return result;
 }
 
+// read the virtual counter. It ticks at the same rate as `get_timestamp`.
+static ALWAYS_INLINE u64 get_virtual_timestamp() {
+    u64 result;
+    compiler_fence();
+    asm volatile("mrs %[cnt], cntvct_el0" : [cnt] "=r"(result));
+    compiler_fence();
+    return result;
+}
+
 // instruction synchronization barrier.
 static ALWAYS_INLINE void arch_isb() {
     asm volatile("isb" ::: "memory");
@@ -84,6 +93,77 @@ static ALWAYS_INLINE u64 arch_get_elr() {
     return result;
 }
 
+// read Fault Address Register (EL1).
+static ALWAYS_INLINE u64 arch_get_far() {
+    u64 result;
+    arch_fence();
+    asm volatile("mrs %[x], far_el1" : [x] "=r"(result));
+    arch_fence();
+    return result;
+}
+
+// make instructions just written to [start, start + size) visible to
+// instruction fetch: clean the data cache to the point of unification, then
+// drop stale instruction cache lines.
+static ALWAYS_INLINE void arch_sync_icache(void *start, usize size) {
+    for (u64 p = (u64)start & ~63ull; p < (u64)start + size; p += 64) {
+        asm volatile("dc cvau, %[x]" : : [x] "r"(p));
+    }
+    asm volatile("dsb ish\n\tic ialluis\n\tdsb ish" ::: "memory");
+    arch_isb();
+}
+
+// write dirty data cache lines covering [start, start + size) back to the
+// point of coherency, so that a DMA engine reading memory sees them.
+static ALWAYS_INLINE void arch_clean_dcache(void *start, usize size) {
+    for (u64 p = (u64)start & ~63ull; p < (u64)start + size; p += 64) {
+        asm volatile("dc cvac, %[x]" : : [x] "r"(p) : "memory");
+    }
+    arch_dsb_sy();
+}
+
+// write back and drop data cache lines covering [start, start + size), so
+// that the CPU reads what a DMA engine has written there. The range should
+// not share cache lines with data written meanwhile.
+static ALWAYS_INLINE void arch_flush_dcache(void *start, usize size) {
+    for (u64 p = (u64)start & ~63ull; p < (u64)start + size; p += 64) {
+        asm volatile("dc civac, %[x]" : : [x] "r"(p) : "memory");
+    }
+    arch_dsb_sy();
+}
+
+// read Data Cache Zero ID Register. Bits [3:0] are log2 of the number of
+// words `dc zva` clears at once. Bit 4 is set if `dc zva` is prohibited.
+static ALWAYS_INLINE u64 arch_get_dczid() {
+    u64 result;
+    asm volatile("mrs %[x], dczid_el0" : [x] "=r"(result));
+    return result;
+}
+
+// zero the block of memory at `addr` without reading it first. `addr` must
+// be aligned to the block size given by `arch_get_dczid`.
+static ALWAYS_INLINE void arch_dc_zva(void *addr) {
+    asm volatile("dc zva, %[x]" : : [x] "r"(addr) : "memory");
+}
+
+// read Thread ID Register (EL1). The kernel keeps the per-CPU offset here.
+static ALWAYS_INLINE u64 arch_get_tid() {
+    u64 result;
+    asm volatile("mrs %[x], tpidr_el1" : [x] "=r"(result));
+    return result;
+}
+
+// set Thread ID Register (EL1).
+static ALWAYS_INLINE void arch_set_tid(u64 tid) {
+    asm volatile("msr tpidr_el1, %[x]" : : [x] "r"(tid));
+}
+
+// set Architectural Feature Access Control Register (EL1).
+static ALWAYS_INLINE void arch_set_cpacr(u64 value) {
+    asm volatile("msr cpacr_el1, %[x]" : : [x] "r"(value));
+    arch_isb();
+}
+
 // set vector base (virtual) address register (EL1).
 static ALWAYS_INLINE void arch_set_vbar(void *ptr) {
     arch_fence();
@@ -98,6 +178,13 @@ static ALWAYS_INLINE void arch_tlbi_vmalle1is() {
     arch_fence();
 }
 
+// flush TLB entries of the page at virtual address `va`.
+static ALWAYS_INLINE void arch_tlbi_vae1is(u64 va) {
+    arch_fence();
+    asm volatile("tlbi vae1is, %[x]" : : [x] "r"(va >> 12));
+    arch_fence();
+}
+
 // set Translation Table Base Register 0 (EL1).
 static ALWAYS_INLINE void arch_set_ttbr0(u64 addr) {
     arch_fence();
@@ -30,10 +30,18 @@
 
 #define PTE_KERNEL (0 << 6)
 #define PTE_USER   (1 << 6)
+#define PTE_RO     (1 << 7)
+
+/* the entry is one of CONT_ENTRIES aligned entries mapping contiguous memory. */
+#define PTE_CONT (1ull << 52)
+
+/* bits 55~58 are ignored by the hardware and left for software. */
+#define PTE_COW (1ull << 55) /* read-only until copied on write */
 
 #define PTE_KERNEL_DATA   (PTE_KERNEL | PTE_NORMAL | PTE_BLOCK)
 #define PTE_KERNEL_DEVICE (PTE_KERNEL | PTE_DEVICE | PTE_BLOCK)
 #define PTE_USER_DATA     (PTE_USER | PTE_NORMAL | PTE_PAGE)
+#define PTE_USER_RO_DATA  (PTE_USER | PTE_RO | PTE_NORMAL | PTE_PAGE)
 
 #define N_PTE_PER_TABLE 512
 
@@ -55,7 +63,7 @@ typedef u64 PTEntry;
 typedef PTEntry PTEntries[N_PTE_PER_TABLE];
 typedef PTEntry *PTEntriesPtr;
 
-#define PTE_ADDRESS(pte)   ((pte) & ~0xFFF)
+#define PTE_ADDRESS(pte)   ((pte) & 0x0000FFFFFFFFF000)
 #define PTE_FLAGS(pte)  ((pte) &  0xFFF)
 
 // fetch PA of pte with part of VA.
@@ -3,8 +3,8 @@
 #include <common/string.h>
 
 static void _print_int(PutCharFunc put_char, void *ctx, i64 u, int _base, bool is_signed) {
-    static char digit[] = "0123456789abcdef";
-    static char buf[64];
+    static const char digit[] = "0123456789abcdef";
+    char buf[64];
 
     u64 v = (u64)u, base = (u64)_base;
     if (is_signed && u < 0) {
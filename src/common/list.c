@@ -43,3 +43,16 @@ ListNode *detach_from_list(ListNode *node) {
     else
         return prev;
 }
+
+void insert_into_list_rcu(ListNode *head, ListNode *node) {
+    ListNode *next = head->next;
+    node->prev = head;
+    node->next = next;
+    next->prev = node;
+    __atomic_store_n(&head->next, node, __ATOMIC_RELEASE);
+}
+
+void detach_from_list_rcu(ListNode *node) {
+    node->next->prev = node->prev;
+    __atomic_store_n(&node->prev->next, node->next, __ATOMIC_RELEASE);
+}
@@ -19,3 +19,17 @@ ListNode *merge_list(ListNode *node1, ListNode *node2);
 // node list. It usually returns `node->prev`. If `node` is
 // the last one in the list, it will return NULL.
 ListNode *detach_from_list(ListNode *node);
+
+// insert the single node `node` right after `head`, so that readers walking
+// the list without locks see it either fully linked or not at all.
+void insert_into_list_rcu(ListNode *head, ListNode *node);
+
+// remove `node` from the list without touching `node->next`, so that
+// readers standing on `node` can go on. `node` must not be reused until a
+// grace period has elapsed (see `core/rcu.h`).
+void detach_from_list_rcu(ListNode *node);
+
+// `node->next`, for readers walking the list without locks.
+static INLINE ListNode *list_next_rcu(ListNode *node) {
+    return __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+}
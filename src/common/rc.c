@@ -8,6 +8,16 @@ void increment_rc(RefCount *rc) {
     __atomic_fetch_add(&rc->count, 1, __ATOMIC_ACQ_REL);
 }
 
+bool increment_rc_not_zero(RefCount *rc) {
+    isize count = __atomic_load_n(&rc->count, __ATOMIC_RELAXED);
+    while (count > 0) {
+        if (__atomic_compare_exchange_n(
+                &rc->count, &count, count + 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            return true;
+    }
+    return false;
+}
+
 bool decrement_rc(RefCount *rc) {
     return __atomic_sub_fetch(&rc->count, 1, __ATOMIC_ACQ_REL) <= 0;
 }
@@ -12,6 +12,11 @@ void init_rc(RefCount *rc);
 // atomic increment reference count by one.
 void increment_rc(RefCount *rc);
 
+// atomic increment reference count by one, unless it is zero. Returns
+// whether it is incremented. Lockless lookups use it to pin objects that
+// may be being freed.
+bool increment_rc_not_zero(RefCount *rc);
+
 // atomic decrement reference count by one. Returns true if reference
 // count becomes zero or below.
 bool decrement_rc(RefCount *rc);
@@ -8,4 +8,6 @@ void init_char_device() {
 void init_uart_char_device(CharDevice *device) {
     device->get = uart_get_char;
     device->put = uart_put_char;
+    device->write = uart_write;
+    device->flush = uart_flush;
 }
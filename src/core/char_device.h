@@ -5,6 +5,8 @@
 typedef struct {
     char (*get)();
     void (*put)(char c);
+    void (*write)(const char *str, usize n);
+    void (*flush)();
 } CharDevice;
 
 void init_char_device();
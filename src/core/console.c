@@ -3,11 +3,20 @@
 #include <common/spinlock.h>
 #include <core/console.h>
 
+// characters are collected on the stack and handed to the device in chunks
+// of this size, so that a line is not interleaved with other CPUs' output.
+#define CONSOLE_BUFFER_SIZE 128
+
 typedef struct {
-    SpinLock lock;
+    SpinLock lock;  // serializes panics.
     CharDevice device;
 } ConsoleContext;
 
+typedef struct {
+    usize size;
+    char data[CONSOLE_BUFFER_SIZE];
+} ConsoleBuffer;
+
 static ConsoleContext ctx;
 
 void init_console() {
@@ -22,42 +31,44 @@ static bool panicked_flag = false;
 
 // check whether other CPUs have already panicked.
 // if true, just terminate itself.
-// note: you must hold `ctx.lock` while checking.
 static void check_panicked() {
     bool panicked = __atomic_load_n(&panicked_flag, __ATOMIC_ACQUIRE);
 
-    if (panicked) {
-        release_spinlock(&ctx.lock);
+    if (panicked)
         no_return();
-    }
+}
+
+static void flush_buffer(ConsoleBuffer *buf) {
+    ctx.device.write(buf->data, buf->size);
+    buf->size = 0;
+}
+
+static void _put_char(void *_buf, char c) {
+    ConsoleBuffer *buf = _buf;
+    if (buf->size == CONSOLE_BUFFER_SIZE)
+        flush_buffer(buf);
+    buf->data[buf->size++] = c;
 }
 
 void puts(const char *str) {
-    acquire_spinlock(&ctx.lock);
     check_panicked();
 
+    ConsoleBuffer buf = {.size = 0};
     while (*str != '\0') {
-        ctx.device.put(*str++);
+        _put_char(&buf, *str++);
     }
 
     // add a trailing newline.
-    ctx.device.put(NEWLINE);
-
-    release_spinlock(&ctx.lock);
-}
-
-static void _put_char(void *_ctx, char c) {
-    (void)_ctx;
-    ctx.device.put(c);
+    _put_char(&buf, NEWLINE);
+    flush_buffer(&buf);
 }
 
 void vprintf(const char *fmt, va_list arg) {
-    acquire_spinlock(&ctx.lock);
     check_panicked();
 
-    vformat(_put_char, NULL, fmt, arg);
-
-    release_spinlock(&ctx.lock);
+    ConsoleBuffer buf = {.size = 0};
+    vformat(_put_char, &buf, fmt, arg);
+    flush_buffer(&buf);
 }
 
 void printf(const char *fmt, ...) {
@@ -67,26 +78,38 @@ void printf(const char *fmt, ...) {
     va_end(arg);
 }
 
+// bypass the device buffer so that the message gets out before we stop.
+static void _put_char_sync(void *_ctx, char c) {
+    (void)_ctx;
+    ctx.device.put(c);
+}
+
 NORETURN void _panic(const char *file, usize line, const char *fmt, ...) {
     acquire_spinlock(&ctx.lock);
-    check_panicked();
+    if (__atomic_load_n(&panicked_flag, __ATOMIC_ACQUIRE)) {
+        release_spinlock(&ctx.lock);
+        no_return();
+    }
 
     // mark the whole system as panicked.
     __atomic_store_n(&panicked_flag, true, __ATOMIC_RELEASE);
 
+    // send what is still buffered first.
+    ctx.device.flush();
+
     // print messages.
 
     for (usize i = 0; i < PANIC_BAR_LENGTH; i++)
         ctx.device.put(PANIC_BAR_CHAR);
     ctx.device.put(NEWLINE);
 
-    format(_put_char, NULL, "KERNEL PANIC at CPU %zu:\n", cpuid());
-    format(_put_char, NULL, "file: %s\n", file);
-    format(_put_char, NULL, "line: %zu\n", line);
+    format(_put_char_sync, NULL, "KERNEL PANIC at CPU %zu:\n", cpuid());
+    format(_put_char_sync, NULL, "file: %s\n", file);
+    format(_put_char_sync, NULL, "line: %zu\n", line);
 
     va_list arg;
     va_start(arg, fmt);
-    vformat(_put_char, NULL, fmt, arg);
+    vformat(_put_char_sync, NULL, fmt, arg);
     va_end(arg);
 
     // add a trailing newline for message.
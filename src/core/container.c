@@ -11,20 +11,6 @@ bool do_cont_test = false;
 
 extern void add_loop_test(int times);
 
-/* 
- * The entry of a new spawned scheduler.
- * Similar to `forkret`.
- * Maintain thiscpu()->scheduler.
- */
-static NO_RETURN void container_entry() {
-    add_loop_test(3);
-    printf("add loop test [%d]\n", cpuid());
-    thiscpu()->scheduler->op->scheduler(thiscpu()->scheduler);
-
-	/* container_entry should enter scheduler and should not return */
-    PANIC("scheduler should not return");
-}
-
 /* 
  * Allocate memory for a container.
  * For root container, a container scheduler is enough. 
@@ -41,23 +27,17 @@ struct container *alloc_container(bool root) {
     cont->scheduler.pid = 1;
     init_spinlock(&cont->scheduler.ptable.lock, "ptable");
     init_spinlock(&cont->lock, "container");
+    cont->shares = SCHED_DEFAULT_SHARES;
     for (int i=0; i<NPROC; i++) {
         init_spinlock(&(cont->scheduler.ptable.proc[i].lock), "process");
     }
     if (root)
         return cont;
+    /* The proc only represents the container in its parent's ptable:
+     * the root scheduler picks processes inside the container directly. */
     cont->p = alloc_pcb();
     cont->p->is_scheduler = true;
     cont->p->cont = cont;
-
-    char *stack = nkalloc(4);
-    cont->p->kstack = stack;
-    for (int i = 1; i <= NCPU; i++) {
-        stack = cont->p->kstack + PAGE_SIZE * i;
-        stack -= sizeof(struct context);
-        cont->scheduler.context[i-1] = (struct context *)stack;
-        cont->scheduler.context[i-1]->r30 = (u64)container_entry;
-    }
     return cont;
 }
 
@@ -104,6 +84,28 @@ void *alloc_resource(struct container *this, struct proc *p, resource_t resource
     }
 }
 
+void set_container_shares(struct container *this, u64 shares) {
+    assert(this->p != NULL && shares > 0);
+    this->shares = shares;
+}
+
+void set_container_quota(struct container *this, u64 quota_ms) {
+    assert(this->p != NULL && quota_ms <= SCHED_PERIOD_MS);
+    this->quota_ms = quota_ms;
+}
+
+int container_id(struct container *this) {
+    return this->p ? this->p->pid : 0;
+}
+
+int root_pid(struct proc *p) {
+    for (int i = 0; i < NPID; i++) {
+        if (root_container->pmap[i].valid && root_container->pmap[i].p == p)
+            return root_container->pmap[i].pid_local;
+    }
+    return -1;
+}
+
 /* 
  * Spawn a new process.
  */
@@ -111,7 +113,6 @@ struct container *spawn_container(struct container *this, struct sched_op *op) {
     container *cont = alloc_container(false);
     acquire_spinlock(&(cont->p->lock));
     cont->p->state = RUNNABLE;
-    cont->p->sz = PAGE_SIZE * NCPU;
     cont->parent = this;
     cont->scheduler.parent = &this->scheduler;
     release_spinlock(&(cont->p->lock));
@@ -129,6 +130,15 @@ void container_test_init() {
     {
         c[i] = spawn_container(root_container, &simple_op);
         assert(c != NULL);
+
+        /* add_loop_test spawns into the current container. */
+        struct scheduler *saved = thiscpu()->scheduler;
+        thiscpu()->scheduler = &c[i]->scheduler;
+        add_loop_test(3);
+        thiscpu()->scheduler = saved;
     }
-    
+
+    /* c[0] should get twice the CPU time of c[1], but at most 50ms of every 100ms. */
+    set_container_shares(c[0], 2 * SCHED_DEFAULT_SHARES);
+    set_container_quota(c[0], SCHED_PERIOD_MS / 2);
 }
@@ -20,6 +20,12 @@ struct container {
     SpinLock lock;
     struct container *parent;
 
+    // cpu
+    u64 shares;        /* weight against siblings, SCHED_DEFAULT_SHARES by default */
+    u64 quota_ms;      /* cpu time allowed per SCHED_PERIOD_MS over all CPUs, 0 for no limit */
+    u64 period_start;  /* counter ticks */
+    u64 period_usage;  /* counter ticks used in the current period */
+
     // pid
     struct pid_mapping pmap[NPID];
 };
@@ -34,4 +40,13 @@ void *alloc_resource(struct container *this, struct proc *p, resource_t resource
 
 void trace_usage(struct container *this, struct proc *p, resource_t resource);
 
+void set_container_shares(struct container *this, u64 shares);
+void set_container_quota(struct container *this, u64 quota_ms);
+
+/* pid of the container's scheduler process, 0 for the root container. */
+int container_id(struct container *this);
+
+/* pid of `p` in the root container, -1 if it has none. */
+int root_pid(struct proc *p);
+
 void container_test_init();
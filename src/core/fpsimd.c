@@ -0,0 +1,88 @@
+#include <aarch64/intrinsic.h>
+#include <common/string.h>
+#include <core/console.h>
+#include <core/fpsimd.h>
+#include <core/percpu.h>
+#include <core/physical_memory.h>
+#include <core/proc.h>
+#include <core/sched.h>
+
+// CPACR_EL1.FPEN: trap EL0 accesses only, or trap nothing.
+#define CPACR_FP_TRAP_EL0 (1 << 20)
+#define CPACR_FP_EN       (3 << 20)
+
+typedef struct {
+    struct proc *owner;  // whose state is in the registers of this CPU.
+    bool user_enabled;   // mirror of CPACR_EL1, to skip redundant writes.
+} FpCpu;
+
+static DEFINE_PER_CPU(FpCpu, fp_cpu);
+
+static void _set_user_access(FpCpu *f, bool enabled) {
+    if (f->user_enabled == enabled)
+        return;
+
+    arch_set_cpacr(enabled ? CPACR_FP_EN : CPACR_FP_TRAP_EL0);
+    f->user_enabled = enabled;
+}
+
+// the registers of this CPU hold the state of `p`: nobody loaded another
+// state here, and `p` did not load its state on another CPU since.
+static bool _holds(FpCpu *f, struct proc *p) {
+    return f->owner == p && p->fp_live == thiscpu();
+}
+
+void fpsimd_switch_in(struct proc *p) {
+    FpCpu *f = this_cpu_ptr(&fp_cpu);
+    _set_user_access(f, _holds(f, p));
+}
+
+void fpsimd_switch_out(struct proc *p) {
+    FpCpu *f = this_cpu_ptr(&fp_cpu);
+    // without access, `p` cannot have changed the registers since the last
+    // save.
+    if (f->user_enabled && f->owner == p)
+        fpsimd_save(p->fpstate);
+}
+
+void fpsimd_trap() {
+    FpCpu *f = this_cpu_ptr(&fp_cpu);
+    struct proc *p = thiscpu()->proc;
+    assert(!_holds(f, p));
+
+    // the previous owner was saved when it was switched out.
+    if (!p->fpstate)
+        p->fpstate = kalloc_zeroed();
+    fpsimd_load(p->fpstate);
+    p->fp_live = thiscpu();
+    f->owner = p;
+
+    // return to the trapping instruction, which runs again.
+    _set_user_access(f, true);
+}
+
+void fpsimd_fork(struct proc *child) {
+    struct proc *p = thiscpu()->proc;
+    if (!p->fpstate)
+        return;
+
+    // the registers may be newer than the saved copy.
+    if (_holds(this_cpu_ptr(&fp_cpu), p))
+        fpsimd_save(p->fpstate);
+    child->fpstate = kalloc();
+    memcpy(child->fpstate, p->fpstate, sizeof(FpState));
+}
+
+void fpsimd_exit(struct proc *p) {
+    FpCpu *f = this_cpu_ptr(&fp_cpu);
+    if (f->owner == p) {
+        f->owner = NULL;
+        _set_user_access(f, false);
+    }
+    p->fp_live = NULL;
+
+    if (p->fpstate) {
+        kfree(p->fpstate);
+        p->fpstate = NULL;
+    }
+}
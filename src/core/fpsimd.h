@@ -0,0 +1,44 @@
+#pragma once
+
+#include <common/defines.h>
+
+// lazy FP/SIMD context switching.
+//
+// user processes may use FP/SIMD registers, but the kernel only loads them
+// when it has to. Each CPU remembers which process owns the contents of its
+// FP/SIMD registers. When any other process runs, EL0 accesses trap
+// (CPACR_EL1.FPEN), and only then is the current process's state loaded.
+// Processes that never touch the registers cost nothing but the CPACR_EL1
+// update.
+//
+// a process that had access is saved when it is switched out, so that it
+// can migrate to any CPU. If it runs on the same CPU again and nobody took
+// the registers over meanwhile, they are still valid and nothing is loaded.
+
+struct proc;
+
+typedef struct FpState {
+    u64 v[64];  // q0~q31.
+    u64 fpsr;
+    u64 fpcr;
+} __attribute__((aligned(16))) FpState;
+
+// provided by `asm/fpsimd.S`.
+void fpsimd_save(FpState *state);
+void fpsimd_load(FpState *state);
+
+// enable or trap EL0 accesses for `p`, which is about to run on this CPU.
+void fpsimd_switch_in(struct proc *p);
+
+// save the registers of `p`, which is about to leave this CPU, if it may
+// have changed them.
+void fpsimd_switch_out(struct proc *p);
+
+// handle the access trap of the current process.
+void fpsimd_trap();
+
+// give `child` a copy of the FP/SIMD state of the current process.
+void fpsimd_fork(struct proc *child);
+
+// drop the FP/SIMD state of the current process `p`, which is exiting.
+void fpsimd_exit(struct proc *p);
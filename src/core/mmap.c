@@ -0,0 +1,101 @@
+#include <aarch64/intrinsic.h>
+#include <aarch64/mmu.h>
+#include <common/string.h>
+#include <core/console.h>
+#include <core/mmap.h>
+#include <core/physical_memory.h>
+#include <core/proc.h>
+#include <core/virtual_memory.h>
+#include <fs/file_map.h>
+
+u64 mmap_file(struct proc *p, usize inode_no, u64 offset, u64 length, bool writable) {
+    if (offset % PAGE_SIZE || length == 0 || length > USER_MMAP_SLOT_SIZE)
+        return (u64)-1;
+
+    for (usize i = 0; i < NMMAP; i++) {
+        struct mmap_region *r = &p->mmaps[i];
+        if (r->end)
+            continue;
+
+        FileMap *file = file_map_get(inode_no);
+        if (file == NULL)
+            return (u64)-1;
+
+        r->start = USER_MMAP_BASE + i * USER_MMAP_SLOT_SIZE;
+        r->end = r->start + ROUNDUP(length, PAGE_SIZE);
+        r->offset = offset;
+        r->file = file;
+        r->writable = writable;
+        return r->start;
+    }
+    return (u64)-1;
+}
+
+static void _unmap(struct proc *p, struct mmap_region *r) {
+    uvm_unmap(p->pgdir, (void *)r->start, r->end - r->start);
+    file_map_put(r->file);
+    memset(r, 0, sizeof(*r));
+}
+
+int munmap_file(struct proc *p, u64 addr) {
+    for (usize i = 0; i < NMMAP; i++) {
+        if (p->mmaps[i].end && p->mmaps[i].start == addr) {
+            _unmap(p, &p->mmaps[i]);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void munmap_all(struct proc *p) {
+    for (usize i = 0; i < NMMAP; i++) {
+        if (p->mmaps[i].end)
+            _unmap(p, &p->mmaps[i]);
+    }
+}
+
+struct mmap_region *mmap_lookup(struct proc *p, u64 addr) {
+    for (usize i = 0; i < NMMAP; i++) {
+        struct mmap_region *r = &p->mmaps[i];
+        if (r->end && addr >= r->start && addr < r->end)
+            return r;
+    }
+    return NULL;
+}
+
+bool mmap_fault(struct proc *p, struct mmap_region *r, u64 va, bool write, bool present) {
+    if (write && !r->writable)
+        return false;
+    usize index = (r->offset + va - r->start) / PAGE_SIZE;
+
+    // the first write to a page mapped for reading.
+    if (present) {
+        PTEntriesPtr pte = pgdir_walk(p->pgdir, (void *)va, 0);
+        if (!write || pte == NULL || !(*pte & PTE_VALID))
+            return false;
+        file_map_set_dirty(r->file, index);
+        *pte &= ~(u64)PTE_RO;
+        arch_tlbi_vae1is(va);
+        return true;
+    }
+
+    void *page = file_map_page(r->file, index);
+    if (page == NULL)
+        return false;
+
+    // pages are mapped read-only until written, so that only written pages
+    // are marked dirty.
+    int ok;
+    if (write) {
+        file_map_set_dirty(r->file, index);
+        ok = uvm_map(p->pgdir, (void *)va, PAGE_SIZE, K2P(page));
+    } else {
+        ok = uvm_map_readonly(p->pgdir, (void *)va, PAGE_SIZE, K2P(page));
+    }
+    if (ok < 0) {
+        kfree(page);
+        return false;
+    }
+    uvm_publish();
+    return true;
+}
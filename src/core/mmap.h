@@ -0,0 +1,32 @@
+#pragma once
+
+#include <common/defines.h>
+
+struct proc;
+struct mmap_region;
+
+// file mappings.
+//
+// `SYS_mymmap` maps a regular file into the user address space. Pages are
+// mapped on the first fault, and the physical pages are the ones kept by
+// `fs/file_map.c`, so every process mapping a file shares them. Writable
+// mappings write back to the file when unmapped. Mappings are not
+// inherited by `fork`.
+
+// map `length` bytes of file `inode_no` from `offset` into `p`. Return the
+// user address, or -1.
+u64 mmap_file(struct proc *p, usize inode_no, u64 offset, u64 length, bool writable);
+
+// remove the mapping of `p` that starts at `addr`. Return -1 if there is
+// none.
+int munmap_file(struct proc *p, u64 addr);
+
+// remove all mappings of `p`, which is exiting.
+void munmap_all(struct proc *p);
+
+// the mapping of `p` containing `addr`, or NULL.
+struct mmap_region *mmap_lookup(struct proc *p, u64 addr);
+
+// resolve a fault at `va` inside mapping `r`. `present` tells a permission
+// fault from a translation fault. Return false if the access is invalid.
+bool mmap_fault(struct proc *p, struct mmap_region *r, u64 va, bool write, bool present);
@@ -0,0 +1,143 @@
+#include <aarch64/intrinsic.h>
+#include <core/console.h>
+#include <core/cpu.h>
+#include <core/mutex.h>
+#include <core/sleeplock.h>
+
+// the token stored in `mutex->owner`. During early boot there is no current
+// process, so the CPU itself owns the mutex.
+static INLINE void *_owner_token() {
+    struct cpu *c = thiscpu();
+    return c->proc ? (void *)c->proc : (void *)c;
+}
+
+static INLINE bool _is_cpu_token(void *owner) {
+    for (usize i = 0; i < NCPU; i++) {
+        if (owner == per_cpu_ptr(&cpus, i))
+            return true;
+    }
+    return false;
+}
+
+// is `owner` currently executing? CPUs never stop executing, and a process
+// is only RUNNING while some CPU has switched to it.
+static INLINE bool _owner_running(void *owner) {
+    if (_is_cpu_token(owner))
+        return true;
+    return __atomic_load_n(&((struct proc *)owner)->state, __ATOMIC_RELAXED) == RUNNING;
+}
+
+void init_mutex(Mutex *mutex, const char *name) {
+    mutex->owner = NULL;
+    init_spinlock(&mutex->lock, name);
+    mutex->num_waiters = 0;
+    mutex->name = name;
+}
+
+bool try_acquire_mutex(Mutex *mutex) {
+    void *expected = NULL;
+    return __atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) == NULL &&
+           __atomic_compare_exchange_n(&mutex->owner,
+                                       &expected,
+                                       _owner_token(),
+                                       false,
+                                       __ATOMIC_SEQ_CST,
+                                       __ATOMIC_RELAXED);
+}
+
+void acquire_mutex(Mutex *mutex) {
+    if (try_acquire_mutex(mutex))
+        return;
+
+    void *me = _owner_token();
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) == me)
+        PANIC("acquire: mutex %s already held\n", mutex->name);
+
+    // spin while the owner is making progress on another CPU.
+    for (usize i = 0; i < MUTEX_SPIN_LIMIT; i++) {
+        void *owner = __atomic_load_n(&mutex->owner, __ATOMIC_RELAXED);
+        if (owner == NULL) {
+            if (try_acquire_mutex(mutex))
+                return;
+        } else if (!_owner_running(owner))
+            break;
+        arch_yield();
+    }
+
+    // without a process there is nothing that can sleep.
+    if (_is_cpu_token(me)) {
+        while (!try_acquire_mutex(mutex)) {
+            arch_yield();
+        }
+        return;
+    }
+
+    // slow path: register as a waiter before the final attempt, so that
+    // either we see the release or the releaser sees us.
+    acquire_spinlock(&mutex->lock);
+    __atomic_add_fetch(&mutex->num_waiters, 1, __ATOMIC_SEQ_CST);
+    while (!try_acquire_mutex(mutex)) {
+        sleep(mutex, &mutex->lock);
+    }
+    __atomic_sub_fetch(&mutex->num_waiters, 1, __ATOMIC_SEQ_CST);
+    release_spinlock(&mutex->lock);
+}
+
+void release_mutex(Mutex *mutex) {
+    if (!holding_mutex(mutex))
+        PANIC("release: mutex %s not held\n", mutex->name);
+
+    __atomic_store_n(&mutex->owner, NULL, __ATOMIC_SEQ_CST);
+
+    // sleepers check the owner while holding `mutex->lock`, so taking it here
+    // guarantees that they are either not yet checking or already asleep.
+    if (__atomic_load_n(&mutex->num_waiters, __ATOMIC_SEQ_CST) > 0) {
+        acquire_spinlock(&mutex->lock);
+        wakeup(mutex);
+        release_spinlock(&mutex->lock);
+    }
+}
+
+bool holding_mutex(Mutex *mutex) {
+    return __atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) == _owner_token();
+}
+
+// compare the uncontended cost of `SpinLock`, `SleepLock` and `Mutex`.
+void mutex_test() {
+    enum { NUM_ROUNDS = 10000 };
+
+    SpinLock spinlock;
+    SleepLock sleeplock;
+    Mutex mutex;
+    init_spinlock(&spinlock, "bench spinlock");
+    init_sleeplock(&sleeplock, "bench sleeplock");
+    init_mutex(&mutex, "bench mutex");
+
+    u64 t = get_timestamp();
+    for (usize i = 0; i < NUM_ROUNDS; i++) {
+        acquire_spinlock(&spinlock);
+        release_spinlock(&spinlock);
+    }
+    u64 spin_cycles = get_timestamp() - t;
+
+    t = get_timestamp();
+    for (usize i = 0; i < NUM_ROUNDS; i++) {
+        acquire_sleeplock(&sleeplock);
+        release_sleeplock(&sleeplock);
+    }
+    u64 sleep_cycles = get_timestamp() - t;
+
+    t = get_timestamp();
+    for (usize i = 0; i < NUM_ROUNDS; i++) {
+        acquire_mutex(&mutex);
+        release_mutex(&mutex);
+    }
+    u64 mutex_cycles = get_timestamp() - t;
+
+    assert(!holding_mutex(&mutex));
+    printf("- mutex test: %d rounds of acquire/release (counter ticks)\n", NUM_ROUNDS);
+    printf("  spinlock: %llu, sleeplock: %llu, mutex: %llu\n",
+           spin_cycles,
+           sleep_cycles,
+           mutex_cycles);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <common/spinlock.h>
+
+// how many times `acquire_mutex` polls the owner before going to sleep.
+#define MUTEX_SPIN_LIMIT 1024
+
+// `Mutex` is an adaptive lock for short critical sections.
+//
+// an uncontended `acquire_mutex` is a single compare-and-swap on `owner`.
+// if the lock is held by a process that is running on another CPU, the
+// caller spins for a while, expecting the owner to release it soon. Only
+// when the owner is not running or the spin budget runs out does the caller
+// sleep on the mutex.
+typedef struct Mutex {
+    void *owner;       // the holding process, or the CPU if no process is running.
+    SpinLock lock;     // serializes sleepers with `release_mutex`.
+    u32 num_waiters;   // number of callers in the sleeping slow path.
+    const char *name;  // for debugging.
+} Mutex;
+
+void init_mutex(Mutex *mutex, const char *name);
+bool try_acquire_mutex(Mutex *mutex);
+void acquire_mutex(Mutex *mutex);
+void release_mutex(Mutex *mutex);
+bool holding_mutex(Mutex *mutex);
+
+void mutex_test();
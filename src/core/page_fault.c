@@ -0,0 +1,97 @@
+#include <aarch64/intrinsic.h>
+#include <aarch64/mmu.h>
+#include <common/string.h>
+#include <core/console.h>
+#include <core/mmap.h>
+#include <core/page_fault.h>
+#include <core/physical_memory.h>
+#include <core/proc.h>
+#include <core/virtual_memory.h>
+
+// fault status code in the ISS of instruction and data aborts.
+#define FSC_MASK        0x3c
+#define FSC_TRANSLATION 0x04
+#define FSC_PERMISSION  0x0c
+
+// set in the ISS of data aborts caused by writes.
+#define ISS_WNR (1 << 6)
+
+// fill `page`, which will be mapped at `va`, from the program of `p`.
+static void _fill_page(struct proc *p, u64 va, void *page) {
+    u64 size = MIN(p->image_size - va, (u64)PAGE_SIZE);
+    memcpy(page, p->image + va, size);
+    memset((char *)page + size, 0, PAGE_SIZE - size);
+
+    // the page may be executed, and the instruction cache does not snoop.
+    arch_sync_icache(page, PAGE_SIZE);
+}
+
+// give `p` its own copy of the copy-on-write page at `va`.
+static bool _copy_on_write(struct proc *p, u64 va) {
+    PTEntriesPtr pte = pgdir_walk(p->pgdir, (void *)va, 0);
+    if (pte == NULL || !(*pte & PTE_COW))
+        return false;
+
+    void *old = (void *)P2K(PTE_ADDRESS(*pte));
+    u64 flags = *pte & ~(PTE_ADDRESS(*pte) | PTE_RO | PTE_COW);
+
+    // the last sharer keeps the page.
+    if (kref_count(old) == 1) {
+        *pte = K2P(old) | flags;
+        arch_tlbi_vae1is(va);
+        return true;
+    }
+
+    void *page = kalloc();
+    if (page == NULL)
+        return false;
+    memcpy(page, old, PAGE_SIZE);
+    if (va < p->image_size)
+        arch_sync_icache(page, PAGE_SIZE);
+
+    // break before make: the old entry must leave the TLB first.
+    *pte = 0;
+    arch_tlbi_vae1is(va);
+    *pte = K2P(page) | flags;
+    arch_fence();
+
+    kfree(old);
+    return true;
+}
+
+bool handle_page_fault(struct proc *p, u64 addr, u64 esr) {
+    u64 va = ROUNDDOWN(addr, PAGE_SIZE);
+    u64 fsc = esr & FSC_MASK;
+
+    struct mmap_region *r = mmap_lookup(p, va);
+    if (r && (fsc == FSC_TRANSLATION || fsc == FSC_PERMISSION))
+        return mmap_fault(p, r, va, esr & ISS_WNR, fsc == FSC_PERMISSION);
+
+    // write faults on shared pages are ours, other permission faults and
+    // alignment faults are bugs of the program.
+    if (fsc == FSC_PERMISSION && (esr & ISS_WNR))
+        return _copy_on_write(p, va);
+    if (fsc != FSC_TRANSLATION)
+        return false;
+
+    bool in_heap = va < p->sz;
+    bool in_stack = va >= USER_STACK_TOP - USER_STACK_SIZE && va < USER_STACK_TOP;
+    if (!in_heap && !in_stack)
+        return false;
+
+    // pages past the program are zero-filled.
+    bool in_program = va < p->image_size;
+    void *page = in_program ? kalloc() : kalloc_zeroed();
+    if (page == NULL)
+        return false;
+    if (in_program)
+        _fill_page(p, va, page);
+
+    if (uvm_map(p->pgdir, (void *)va, PAGE_SIZE, K2P(page)) < 0) {
+        kfree(page);
+        return false;
+    }
+
+    uvm_publish();
+    return true;
+}
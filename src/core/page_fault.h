@@ -0,0 +1,19 @@
+#pragma once
+
+#include <common/defines.h>
+
+struct proc;
+
+// demand paging.
+//
+// user address spaces are populated lazily. A process starts with no user
+// pages at all: `[0, image_size)` is loaded from `p->image` on the first
+// touch, the rest of `[0, sz)` is heap and the stack below `USER_STACK_TOP`
+// grows on demand, both backed by zero-filled pages. Pages shared by `fork`
+// are copied on the first write. Mapped files are handled by `mmap.c`.
+
+// resolve a translation fault or a copy-on-write fault of `p` at `addr`.
+// `esr` is the syndrome of the instruction or data abort. Return false if
+// the access is invalid.
+bool handle_page_fault(struct proc *p, u64 addr, u64 esr);
+
@@ -0,0 +1,27 @@
+#include <common/string.h>
+#include <core/percpu.h>
+#include <core/sched.h>
+
+// provided by `linker.ld`.
+extern char percpu_start[], percpu_end[];
+
+// per-CPU areas are filled before the BSS section is cleared, so keep them
+// in `.data`.
+__attribute__((section(".data"), aligned(CACHE_LINE_SIZE)))
+static u8 percpu_areas[NCPU][PERCPU_AREA_SIZE];
+
+u64 percpu_offset(usize cpu) {
+    return (u64)percpu_areas[cpu] - (u64)percpu_start;
+}
+
+void init_percpu() {
+    usize cpu = cpuid();
+    usize size = (usize)(percpu_end - percpu_start);
+
+    // no console yet.
+    if (size > PERCPU_AREA_SIZE)
+        no_return();
+
+    memcpy(percpu_areas[cpu], percpu_start, size);
+    arch_set_tid(percpu_offset(cpu));
+}
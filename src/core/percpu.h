@@ -0,0 +1,37 @@
+#pragma once
+
+#include <aarch64/intrinsic.h>
+#include <common/defines.h>
+
+// size reserved for the per-CPU variables of one CPU.
+#define PERCPU_AREA_SIZE 32768
+
+// per-CPU variables.
+//
+// `DEFINE_PER_CPU` places a variable into the `.data.percpu` section. The
+// section is only a template: at boot every CPU copies it into its own
+// cache-line-aligned area and stores the distance from the template to that
+// area in `TPIDR_EL1`. `this_cpu_ptr(&var)` therefore costs one system
+// register read and one addition, and copies of different CPUs never share
+// a cache line.
+//
+// > DEFINE_PER_CPU(u64, num_ticks);
+// > (*this_cpu_ptr(&num_ticks))++;
+//
+// NOTE: the current CPU may change once the caller is preempted. Callers of
+// `this_cpu_ptr` should either disable traps or not care about migration.
+#define DEFINE_PER_CPU(type, name) __attribute__((section(".data.percpu"))) type name
+#define DECLARE_PER_CPU(type, name) extern type name
+
+// return the copy of `*ptr` owned by the current CPU.
+#define this_cpu_ptr(ptr) ((typeof(ptr))((u64)(ptr) + arch_get_tid()))
+
+// return the copy of `*ptr` owned by `cpu`.
+#define per_cpu_ptr(ptr, cpu) ((typeof(ptr))((u64)(ptr) + percpu_offset(cpu)))
+
+// set up the per-CPU area of the current CPU. It must be the first thing
+// every CPU does in `main`.
+void init_percpu();
+
+// distance between the template and the per-CPU area of `cpu`.
+u64 percpu_offset(usize cpu);
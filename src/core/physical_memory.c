@@ -1,14 +1,32 @@
+#include <aarch64/intrinsic.h>
 #include <aarch64/mmu.h>
 #include <common/types.h>
 #include <core/physical_memory.h>
 #include <core/console.h>
 #include <common/string.h>
+#include <core/trace.h>
+#include <core/workqueue.h>
 
 extern char end[];
 PMemory pmem; /* : Lab4 multicore: Add locks where needed */
 /* FreeListNode head; */
 static char pagepool[PAGEPOOLSIZE];
+/* References to each allocated page. `kfree` only frees the last one. */
+static u16 pagerefs[PAGEPOOLSIZE];
 static u64 poolnumend = PAGEPOOLSIZE;
+/*
+ * Pages zeroed ahead of time for `kalloc_zeroed`, by idle CPUs and by a
+ * worker once fewer than ZEROED_POOL_LOW are left.
+ */
+#define ZEROED_POOL_SIZE 64
+#define ZEROED_POOL_LOW  (ZEROED_POOL_SIZE / 4)
+static struct {
+    SpinLock lock;
+    int count;
+    void *pages[ZEROED_POOL_SIZE];
+} zeroed;
+static Work refill_work;
+static bool refill_ready;
 static void *pagestart = NULL;
 /*
  * Editable, as long as it works as a memory manager.
@@ -50,6 +68,7 @@ static void *pool_alloc(int numpages) {
     if (page) {
         for (j = i; j < i+numpages; j++) {
             pagepool[j] = 0x1;
+            pagerefs[j] = 1;
         }
     }
     release_spinlock(&pmem.pmemlock);
@@ -87,6 +106,7 @@ void init_memory_manager(void) {
     void *ROUNDUP_end = ROUNDUP((void *)end, PAGE_SIZE);
     init_PMemory(&pmem);
     init_spinlock(&pmem.pmemlock, "pmem");
+    init_spinlock(&zeroed.lock, "zeroed pages");
 
     pmem.page_init(ROUNDUP_end, (void *)P2K(phystop));
 }
@@ -95,24 +115,126 @@ void *nkalloc(int numpages) {
     void *p = pmem.page_nalloc(numpages);
     if (p == NULL) 
         PANIC("kmem: nkalloc fails.");
+    trace_event(TRACE_KALLOC, (u64)p, (u64)numpages);
     return p;
 }
 
 void nfree(void *page_address, int numpages) {
+    trace_event(TRACE_KFREE, (u64)page_address, (u64)numpages);
     pmem.page_nfree(page_address, numpages);
 }
 
+/* Take a page from the zeroed pool. Returns NULL if it is empty. */
+static void *take_zeroed(void) {
+    void *p = NULL;
+    acquire_spinlock(&zeroed.lock);
+    if (zeroed.count > 0)
+        p = zeroed.pages[--zeroed.count];
+    release_spinlock(&zeroed.lock);
+    return p;
+}
+
+/*
+ * `dc zva` zeroes a block of cache lines at a time without fetching them
+ * from memory first.
+ */
+static void zero_page(void *page) {
+    u64 dczid = arch_get_dczid();
+    if (dczid & 0x10) {
+        memset(page, 0, PAGE_SIZE);
+        return;
+    }
+    usize block = 4ul << (dczid & 0xf);
+    for (char *p = page; p < (char *)page + PAGE_SIZE; p += block)
+        arch_dc_zva(p);
+}
+
 void *kalloc(void) {
     void *p = pmem.page_nalloc(1);
+    /* When memory runs out, the zeroed pool is the last resort. */
+    if (p == NULL)
+        p = take_zeroed();
     if (p == NULL)
         PANIC("kmem: kalloc fails.");
+    trace_event(TRACE_KALLOC, (u64)p, 1);
+    return p;
+}
+
+/* Fill the zeroed pool up, or until memory runs out. */
+static void refill_zeroed(Work *work) {
+    (void)work;
+    while (prezero_page())
+        ;
+}
+
+void start_zeroed_refill(void) {
+    init_work(&refill_work, refill_zeroed, 0);
+    __atomic_store_n(&refill_ready, true, __ATOMIC_RELEASE);
+}
+
+void *kalloc_zeroed(void) {
+    void *p = take_zeroed();
+    /* Busy CPUs never go idle to zero pages: hand the refill to a worker. */
+    if (__atomic_load_n(&zeroed.count, __ATOMIC_RELAXED) < ZEROED_POOL_LOW &&
+        __atomic_load_n(&refill_ready, __ATOMIC_ACQUIRE))
+        queue_work(&refill_work);
+    if (p == NULL) {
+        p = kalloc();
+        zero_page(p);
+        return p;
+    }
+    trace_event(TRACE_KALLOC, (u64)p, 1);
     return p;
 }
 
+bool prezero_page(void) {
+    if (__atomic_load_n(&zeroed.count, __ATOMIC_RELAXED) >= ZEROED_POOL_SIZE)
+        return false;
+    void *p = pmem.page_nalloc(1);
+    if (p == NULL)
+        return false;
+    zero_page(p);
+
+    acquire_spinlock(&zeroed.lock);
+    bool full = zeroed.count >= ZEROED_POOL_SIZE;
+    if (!full)
+        zeroed.pages[zeroed.count++] = p;
+    release_spinlock(&zeroed.lock);
+
+    /* Another CPU filled the pool in the meantime. */
+    if (full)
+        pmem.page_nfree(p, 1);
+    return !full;
+}
+
+/* Index of an allocated page in `pagepool` and `pagerefs`. */
+static usize page_index(void *page_address) {
+    u64 offset = (u64)page_address - (u64)pagestart;
+    if (offset % PAGE_SIZE)
+        PANIC("kmem: page address not aligned.\n");
+    assert(offset / PAGE_SIZE < poolnumend);
+    return offset / PAGE_SIZE;
+}
+
 void kfree(void *page_address) {
+    u16 *refs = &pagerefs[page_index(page_address)];
+    asserts(__atomic_load_n(refs, __ATOMIC_RELAXED) > 0, "kmem: refree page %p", page_address);
+    if (__atomic_sub_fetch(refs, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    trace_event(TRACE_KFREE, (u64)page_address, 1);
     pmem.page_nfree(page_address, 1);
 }
 
+void kref(void *page_address) {
+    u16 *refs = &pagerefs[page_index(page_address)];
+    assert(__atomic_load_n(refs, __ATOMIC_RELAXED) > 0);
+    __atomic_add_fetch(refs, 1, __ATOMIC_RELAXED);
+}
+
+int kref_count(void *page_address) {
+    return __atomic_load_n(&pagerefs[page_index(page_address)], __ATOMIC_ACQUIRE);
+}
+
 /*
  * Allocate one 4096-byte page of physical memory.
  * Returns a pointer that the kernel can use.
@@ -29,7 +29,24 @@ void init_memory_manager(void);
 /* void free_range(void *start, void *end); */
 void *kalloc(void);
 void *nkalloc(int numpages);
+/* Allocate a zero-filled page, preferably one zeroed ahead of time. */
+void *kalloc_zeroed(void);
+/*
+ * Zero one page ahead of time for `kalloc_zeroed`. Idle CPUs call it.
+ * Returns false if there is nothing to do.
+ */
+bool prezero_page(void);
+/*
+ * Let `kalloc_zeroed` queue the refill of the zeroed pool on the workqueue
+ * when it runs low. Call it once the workers are spawned.
+ */
+void start_zeroed_refill(void);
+/* Drop a reference to a page. The page is freed with the last one. */
 void kfree(void *page_address);
+/* Take another reference to a page from `kalloc`, e.g. to share it. */
+void kref(void *page_address);
+/* Number of references to a page from `kalloc`. */
+int kref_count(void *page_address);
 void nkfree(void *page_address);
 
 #endif
@@ -7,10 +7,17 @@
 #include <core/sched.h>
 #include <core/virtual_memory.h>
 #include <core/container.h>
+#include <core/fpsimd.h>
+#include <core/mmap.h>
+#include <core/trace.h>
+#include <core/vdso.h>
+#include <core/workqueue.h>
+#include <driver/interrupt.h>
 #include <fs/fs.h>
 
 extern void to_forkret();
 extern void to_initret();
+extern void to_kthreadret();
 extern void trap_return();
 /*
  * Look through the process table for an UNUSED proc.
@@ -28,36 +35,58 @@ extern void trap_return();
 static struct proc *alloc_proc() {
     struct proc *p;
     p = alloc_pcb();
-    char* stack = kalloc();
+    if (p == NULL)
+        return NULL;
+    /* The stack comes zeroed, trapframe and context included. */
+    char* stack = kalloc_zeroed();
 
     acquire_spinlock(&p->lock);
     p -> kstack = stack;
     stack += KSTACKSIZE;
     stack -= sizeof(*(p->tf));
-    memset(stack, 0, sizeof(*(p->tf)));
     p -> tf = (Trapframe *)stack;
     stack -= sizeof(*(p->context));
-    memset(stack, 0, sizeof(*(p->context)));
     p -> context = (struct context *)stack;
     release_spinlock(&p->lock);
 
     return p;
 }
 
+/*
+ * Give back a proc from `alloc_proc()` that never ran, with whatever part of
+ * its address space was built. The caller holds `p->lock`.
+ */
+static void free_proc(struct proc *p) {
+    if (p -> pgdir)
+        vm_free(p -> pgdir);
+    p -> pgdir = NULL;
+    kfree(p -> kstack);
+    p -> kstack = NULL;
+    p -> state = UNUSED;
+}
+
+/*
+ * Prepare `p` to run the program in [start, end) from address 0.
+ * Nothing is copied or mapped here: program pages are loaded on their first
+ * fault, and the heap (starting at the page after the program) and the stack
+ * are zero-filled on demand. See `page_fault.c`.
+ */
+static void load_program(struct proc *p, char *start, char *end) {
+    p -> image = start;
+    p -> image_size = (u64)(end - start);
+    p -> sz = ROUNDUP(p -> image_size, PAGE_SIZE);
+    p -> tf -> SP_EL0 = USER_STACK_TOP;
+}
+
 /*
  * Set up first user process(Only used once).
  * Step 1: Allocate a configured proc struct by `alloc_proc()`.
- * Step 2 (): Allocate memory for storing the code of init process.
- * Step 3 (): Copy the code (ranging icode to eicode) to memory.
- * Step 4 (): Map any va to this page.
- * Step 5 (): Set the address after eret to this va.
- * Step 6 (): Set proc->sz.
+ * Step 2 (): Point the process at the code (ranging icode to eicode).
+ * Step 3 (): Set proc->sz and the user stack.
  */
 void spawn_init_process() {
     struct proc *p;
     extern char icode[], eicode[];
-    u64 cpsize = (u64)(eicode - icode), tmpsize;
-    PTEntriesPtr PagePtr;
     p = alloc_proc();
     
     acquire_spinlock(&p->lock);
@@ -66,17 +95,9 @@ void spawn_init_process() {
     if ((p->pgdir = pgdir_init()) == NULL)
         PANIC("Could not initialize root pagetable");
     printf("[spawn_init_process] (pid = %d)\n", p->pid);
-    for(u64 vplace = 0; vplace < cpsize; vplace += PAGE_SIZE) {
-        PagePtr = kalloc();
-        if (PagePtr == NULL) 
-            PANIC("kalloc failed");
-        tmpsize = (cpsize-vplace > PAGE_SIZE)? PAGE_SIZE : (cpsize-vplace);
-        uvm_map(p->pgdir, vplace, tmpsize, K2P(PagePtr));
-        memcpy(PagePtr, icode + vplace, tmpsize);
-    }
+    load_program(p, icode, eicode);
     
     p -> state = RUNNABLE;
-    p -> sz = PAGE_SIZE;
     p -> context -> r30 = (u64)to_initret;
 
     release_spinlock(&p->lock);
@@ -87,10 +108,15 @@ void spawn_init_process() {
  */
 void forkret() {
 	/* : Lab3 Process */
+    sched_finish_switch();
+    vdso_setup(thiscpu()->proc);
 }
 
 void initret() {
+    sched_finish_switch();
+    vdso_setup(thiscpu()->proc);
 
+    workqueue_test();
     sd_test();
 }
 
@@ -103,6 +129,15 @@ void exit() {
     /* : Lab3 Process */
     // acquire_sched_lock();
     proc * p = thiscpu() -> proc;
+    fpsimd_exit(p);
+    /* Drop the user pages, so that pages shared with a fork stop being copied. */
+    munmap_all(p);
+    /* Leave the address space before its tables go, taking its TLB entries along. */
+    PTEntriesPtr pgdir = p -> pgdir;
+    p -> pgdir = NULL;
+    uvm_switch(NULL);
+    vm_free(pgdir);
+    p -> vdso = p -> uring = NULL;
     p -> state = ZOMBIE;
     // release_sched_lock();
     printf("\n[exit] process (pid = %d) at exit.\n", p->pid);
@@ -110,6 +145,85 @@ void exit() {
     PANIC("ERROR: ZOMBIE trying return from exit");
 }
 
+/*
+ * Create a kernel thread named `name` that runs `func(arg)`, bound to `cpu`
+ * unless it is negative. A kernel thread lives in EL1 only: it has no user
+ * address space (`pgdir` is NULL), no trapframe in use and no vdso. Like
+ * all kernel code it is never preempted, so it should sleep when idle.
+ * It becomes a zombie when `func` returns.
+ */
+struct proc *create_kthread(const char *name, KthreadFunc func, u64 arg, isize cpu) {
+    struct proc *p = alloc_proc();
+    if (p == NULL)
+        PANIC("Could not allocate kernel thread %s", name);
+
+    acquire_spinlock(&p->lock);
+    strncpy(p->name, name, sizeof(p->name) - 1);
+    if (cpu >= 0)
+        bound_processor(p, (u64)cpu);
+
+    /* `to_kthreadret` finds the function and its argument in x19 and x20. */
+    p -> context -> r19 = (u64)func;
+    p -> context -> r20 = arg;
+    p -> context -> r30 = (u64)to_kthreadret;
+    p -> state = RUNNABLE;
+    p -> runnable_since = get_timestamp();
+    release_spinlock(&p->lock);
+
+    return p;
+}
+
+/*
+ * A kernel thread whose function returned comes here. There are no user
+ * pages to free.
+ */
+void kthread_exit() {
+    proc *p = thiscpu() -> proc;
+    assert(p -> pgdir == NULL);
+    p -> state = ZOMBIE;
+    sched();
+    PANIC("ERROR: ZOMBIE kernel thread trying to run");
+}
+
+/*
+ * Create a copy of the current process, which entered the kernel through
+ * `SYS_myfork` with a full trapframe. User pages are shared copy-on-write
+ * instead of copied, so the cost depends on the page table rather than the
+ * address space. The vdso page and syscall rings are not inherited.
+ * Return the pid of the child, which sees 0 instead, or -1 if the process
+ * table or memory is exhausted.
+ */
+int fork() {
+    proc *p = thiscpu() -> proc;
+    proc *np = alloc_proc();
+    if (np == NULL)
+        return -1;
+
+    acquire_spinlock(&np->lock);
+    if ((np->pgdir = pgdir_init()) == NULL ||
+        uvm_share(np->pgdir, p->pgdir, 0, p->sz) < 0 ||
+        uvm_share(np->pgdir, p->pgdir, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_TOP) < 0) {
+        free_proc(np);
+        release_spinlock(&np->lock);
+        return -1;
+    }
+
+    np -> image = p -> image;
+    np -> image_size = p -> image_size;
+    np -> sz = p -> sz;
+    np -> parent = p;
+    *(np -> tf) = *(p -> tf);
+    np -> tf -> r0 = 0;
+    fpsimd_fork(np);
+
+    np -> state = RUNNABLE;
+    np -> runnable_since = get_timestamp();
+    np -> context -> r30 = (u64)to_forkret;
+    release_spinlock(&np->lock);
+
+    return np -> pid;
+}
+
 /*
  * Give up CPU.
  * Switch to the scheduler of this proc.
@@ -118,6 +232,7 @@ void yield() {
     struct cpu *c = thiscpu();
     proc *p = c->proc;
     p->state = RUNNABLE;
+    p->runnable_since = get_timestamp();
     // printf("\n[yield] p : %p\n", p);
     sched();
 }
@@ -131,10 +246,17 @@ void sleep(void *chan, SpinLock *lock) {
     p -> state = SLEEPING;
     p -> chan = chan;
     // printf("\n[sleep] process(pid = %d)[%p]\n", p->pid, p);
+    trace_event(TRACE_SLEEP, (u64)chan, 0);
+    // the scheduler keeps `p->lock` until we are switched out, so a wakeup
+    // after this point cannot run `p` on another CPU prematurely.
     if (lock) {
-        acquire_spinlock(lock);
+        release_spinlock(lock);
     }
     sched();
+    p -> chan = NULL;
+    if (lock) {
+        acquire_spinlock(lock);
+    }
     // printf("\n[sleep] chan[%p] process(pid = %d)[%p] wake up.\n", chan, p->pid, p);
 }
 
@@ -145,6 +267,8 @@ static void rec_wakeup(void *chan, struct scheduler *this) {
         if (p->state == SLEEPING && p->chan == chan) 
         {
             p->state = RUNNABLE;
+            p->runnable_since = get_timestamp();
+            p->vruntime = MAX(p->vruntime, this->min_vruntime);
         }
         if (p->is_scheduler) 
         {
@@ -156,6 +280,7 @@ static void rec_wakeup(void *chan, struct scheduler *this) {
 /* Wake up all processes sleeping on chan. */
 void wakeup(void *chan) {
     // printf("\n[wake] chan:[%p]\n", chan);
+    trace_event(TRACE_WAKEUP, (u64)chan, 0);
     struct cpu *c = thiscpu();
     rec_wakeup(chan, &root_container->scheduler);
 }
@@ -168,8 +293,6 @@ void add_loop_test(int times) {
     for (int i = 0; i < times; i++) {
         struct proc *p;
         extern char loop_start[], loop_end[];
-        u64 cpsize = loop_end - loop_start, tmpsize;
-        PTEntriesPtr PagePtr;
         p = alloc_proc();
 
         acquire_spinlock(&p->lock);
@@ -179,17 +302,9 @@ void add_loop_test(int times) {
         if ((p->pgdir = pgdir_init()) == NULL)
             PANIC("Could not initialize root pagetable");
             
-        for(u64 vplace = 0; vplace < cpsize; vplace += PAGE_SIZE) {
-            PagePtr = kalloc();
-            if (PagePtr == NULL) 
-                PANIC("kalloc failed");
-            tmpsize = (cpsize-vplace > PAGE_SIZE)? PAGE_SIZE : (cpsize-vplace);
-            uvm_map(p->pgdir, vplace, tmpsize, K2P(PagePtr));
-            memcpy(PagePtr, loop_start + vplace, tmpsize);
-        }
+        load_program(p, loop_start, loop_end);
 
         p -> state = RUNNABLE;
-        p -> sz = PAGE_SIZE;
         p -> context -> r30 = (u64)to_forkret;
 
         release_spinlock(&p->lock);
@@ -200,8 +315,6 @@ void add_loop_test(int times) {
 void add_sd_test() {
     struct proc *p;
     extern char sdtest_start[], sdtest_end[];
-    u64 cpsize = (u64)(sdtest_end - sdtest_start), tmpsize;
-    PTEntriesPtr PagePtr;
     p = alloc_proc();
     
     acquire_spinlock(&p->lock);
@@ -212,17 +325,9 @@ void add_sd_test() {
         PANIC("Could not initialize root pagetable");
     printf("\n[add_sd_test] (pid = %d)\n", p->pid);
 
-    for(u64 vplace = 0; vplace < cpsize; vplace += PAGE_SIZE) {
-        PagePtr = kalloc();
-        if (PagePtr == NULL) 
-            PANIC("kalloc failed");
-        tmpsize = (cpsize-vplace > PAGE_SIZE)? PAGE_SIZE : (cpsize-vplace);
-        uvm_map(p->pgdir, vplace, tmpsize, K2P(PagePtr));
-        memcpy(PagePtr, sdtest_start + vplace, tmpsize);
-    }
+    load_program(p, sdtest_start, sdtest_end);
     
     p -> state = RUNNABLE;
-    p -> sz = PAGE_SIZE;
     p -> context -> r30 = (u64)to_initret;
 
     release_spinlock(&p->lock);
@@ -232,8 +337,6 @@ void add_sd_test() {
 void sd_init_idle() {
     struct proc *p;
     extern char sdloop_start[], sdloop_end[];
-    u64 cpsize = (u64)(sdloop_end - sdloop_start), tmpsize;
-    PTEntriesPtr PagePtr;
     p = alloc_proc();
     
     acquire_spinlock(&p->lock);
@@ -244,21 +347,76 @@ void sd_init_idle() {
         PANIC("Could not initialize root pagetable");
     printf("\n[add_sd_loop] (pid = %d)\n", p->pid);
 
-    for(u64 vplace = 0; vplace < cpsize; vplace += PAGE_SIZE) {
-
-        PagePtr = kalloc();
-        if (PagePtr == NULL) 
-            PANIC("kalloc failed");
-        tmpsize = (cpsize-vplace > PAGE_SIZE)? PAGE_SIZE : (cpsize-vplace);
-        uvm_map(p->pgdir, vplace, tmpsize, K2P(PagePtr));
-        memcpy(PagePtr, sdloop_start + vplace, tmpsize);
-
-    }
+    load_program(p, sdloop_start, sdloop_end);
     
     p -> state = RUNNABLE;
-    p -> sz = PAGE_SIZE;
     p -> context -> r30 = (u64)to_forkret;
-    bound_processor_pid(p->pid, 0);
+    /* Keep the core taking interrupts in user space when it is idle. */
+    bound_processor_pid(p->pid, interrupt_route());
+
+    release_spinlock(&p->lock);
+}
+/*
+ * Start the user program in [start, end) as a new process named `name` in
+ * the log, entering through `entry`. Bind it to `cpu` unless it is negative.
+ */
+static void spawn_program(const char *name, char *start, char *end, void (*entry)(), int cpu) {
+    struct proc *p = alloc_proc();
+    if (p == NULL)
+        PANIC("Could not allocate process");
+
+    acquire_spinlock(&p->lock);
+
+    if ((p->pgdir = pgdir_init()) == NULL)
+        PANIC("Could not initialize root pagetable");
+    printf("\n[%s] (pid = %d)\n", name, p->pid);
+
+    load_program(p, start, end);
+
+    p -> state = RUNNABLE;
+    p -> context -> r30 = (u64)entry;
+    if (cpu >= 0)
+        bound_processor(p, (u64)cpu);
 
     release_spinlock(&p->lock);
-}
\ No newline at end of file
+}
+/* Initialize new user program to benchmark syscall latency. */
+void add_syscall_bench() {
+    extern char syscallbench_start[], syscallbench_end[];
+    spawn_program(__func__, syscallbench_start, syscallbench_end, to_forkret, -1);
+}
+/*
+ * Initialize two user programs that yield to each other, to benchmark
+ * context switch latency. Both are bound to the last CPU.
+ */
+void add_pingpong_bench() {
+    extern char pingpong_start[], pingpong_end[];
+    for (int i = 0; i < 2; i++)
+        spawn_program(__func__, pingpong_start, pingpong_end, to_forkret, NCPU - 1);
+}
+/* Initialize two user programs that check their FP/SIMD registers. */
+void add_fp_test() {
+    extern char fptest_start[], fptest_end[];
+    for (int i = 0; i < 2; i++)
+        spawn_program(__func__, fptest_start, fptest_end, to_forkret, -1);
+}
+/* Initialize new user program to check and time the vdso page. */
+void add_vdso_test() {
+    extern char vdsotest_start[], vdsotest_end[];
+    spawn_program(__func__, vdsotest_start, vdsotest_end, to_forkret, -1);
+}
+/* Initialize new user program to exercise the syscall rings. */
+void add_uring_test() {
+    extern char uringtest_start[], uringtest_end[];
+    spawn_program(__func__, uringtest_start, uringtest_end, to_forkret, -1);
+}
+/* Initialize new user program to exercise demand paging. */
+void add_pagefault_test() {
+    extern char pftest_start[], pftest_end[];
+    spawn_program(__func__, pftest_start, pftest_end, to_forkret, -1);
+}
+/* Initialize new user program that forks a copy-on-write child. */
+void add_fork_test() {
+    extern char forktest_start[], forktest_end[];
+    spawn_program(__func__, forktest_start, forktest_end, to_forkret, -1);
+}
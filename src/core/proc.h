@@ -8,6 +8,7 @@
 #define NPROC      16   /* maximum number of processes */
 #define NOFILE     16   /* open files per process */
 #define KSTACKSIZE 4096 /* size of per-process kernel stack */
+#define NMMAP      4    /* file mappings per process */
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
@@ -36,6 +37,14 @@ struct context {
 	u64 r30;
 };
 
+/* A file mapped at [start, end) of the user address space. */
+struct mmap_region {
+    u64 start, end;  /* page aligned, end == 0 if the slot is unused */
+    u64 offset;      /* file offset mapped at start, page aligned */
+    void *file;      /* FileMap of the file */
+    bool writable;
+};
+
 struct proc {
     u64 sz;                  /* Size of process memory (bytes)          */
     u64 *pgdir;              /* Page table                              */
@@ -52,14 +61,36 @@ struct proc {
     bool is_scheduler;
 	SpinLock lock;
 	u64 bounding;
+    void *vdso;              /* Kernel address of the vdso page         */
+    void *uring;             /* Kernel address of the syscall rings     */
+    u64 runtime;             /* CPU time used, in counter ticks         */
+    u64 last_run;            /* When it was last switched in            */
+    u64 runnable_since;      /* When it became RUNNABLE, 0 if unknown   */
+    u64 vruntime;            /* Weighted runtime, for fair scheduling   */
+    void *fpstate;           /* Saved FP/SIMD registers, or NULL        */
+    void *fp_live;           /* struct cpu they were last loaded on     */
+    char *image;             /* Program loaded lazily at address 0      */
+    u64 image_size;          /* Size of the program in bytes            */
+    struct mmap_region mmaps[NMMAP]; /* Files mapped by `SYS_mymmap`    */
 };
+typedef void (*KthreadFunc)(u64 arg);
 typedef struct proc proc;
 void init_proc();
 void spawn_init_process();
 void yield();
 NO_RETURN void exit();
+int fork();
 void sleep(void *chan, SpinLock *lock);
+struct proc *create_kthread(const char *name, KthreadFunc func, u64 arg, isize cpu);
+NO_RETURN void kthread_exit();
 void wakeup(void *chan);
 void add_loop_test(int times);
 void add_sd_test(); /* lab7: sd driver */
 void sd_init_idle(); /* lab7: sd driver */
+void add_syscall_bench();
+void add_pingpong_bench();
+void add_fp_test();
+void add_vdso_test();
+void add_uring_test();
+void add_pagefault_test();
+void add_fork_test();
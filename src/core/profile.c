@@ -0,0 +1,91 @@
+#include <common/string.h>
+#include <core/console.h>
+#include <core/container.h>
+#include <core/percpu.h>
+#include <core/profile.h>
+#include <core/sched.h>
+#include <driver/clock.h>
+
+// how many buckets to probe before a sample is dropped.
+#define MAX_PROBES 16
+
+typedef struct {
+    u64 pc;
+    u32 pid;
+    u32 container;  // pid of the container's scheduler, zero for the root.
+    u64 count;      // zero if the bucket is unused.
+} ProfileBucket;
+
+typedef struct {
+    u64 num_samples;
+    u64 num_dropped;  // samples that found no free bucket.
+    ProfileBucket buckets[PROFILE_NUM_BUCKETS];
+} ProfileHistogram;
+
+static DEFINE_PER_CPU(ProfileHistogram, histogram);
+static bool running;
+
+// called from the clock interrupt, so there is no migration in between.
+static void profile_sample(Trapframe *frame) {
+    ProfileHistogram *h = this_cpu_ptr(&histogram);
+    struct cpu *c = thiscpu();
+    container *cont = c->scheduler ? c->scheduler->cont : NULL;
+
+    u64 pc = frame->ELR_EL1;
+    u32 pid = c->proc ? (u32)c->proc->pid : 0;
+    u32 cont_id = cont ? (u32)container_id(cont) : 0;
+
+    h->num_samples++;
+    usize hash = (usize)((pc >> 2) ^ (pc >> 12) ^ ((u64)pid << 4) ^ cont_id);
+    for (usize i = 0; i < MAX_PROBES; i++) {
+        ProfileBucket *b = &h->buckets[(hash + i) & (PROFILE_NUM_BUCKETS - 1)];
+        if (b->count == 0) {
+            b->pc = pc;
+            b->pid = pid;
+            b->container = cont_id;
+            b->count = 1;
+            return;
+        }
+        if (b->pc == pc && b->pid == pid && b->container == cont_id) {
+            b->count++;
+            return;
+        }
+    }
+    h->num_dropped++;
+}
+
+void profile_start(u64 frequency) {
+    assert(!running);
+    for (usize i = 0; i < NCPU; i++) {
+        memset(per_cpu_ptr(&histogram, i), 0, sizeof(ProfileHistogram));
+    }
+    running = true;
+    set_clock_sampler(profile_sample, frequency);
+}
+
+void profile_stop() {
+    set_clock_sampler(NULL, 0);
+    running = false;
+}
+
+// the format is parsed by `scripts/symbolize.py`.
+void profile_dump() {
+    for (usize i = 0; i < NCPU; i++) {
+        ProfileHistogram *h = per_cpu_ptr(&histogram, i);
+        printf("- profile: cpu=%zu samples=%llu dropped=%llu\n",
+               i,
+               h->num_samples,
+               h->num_dropped);
+        for (usize j = 0; j < PROFILE_NUM_BUCKETS; j++) {
+            ProfileBucket *b = &h->buckets[j];
+            if (b->count == 0)
+                continue;
+            printf("  sample pc=0x%llx pid=%u container=%u cpu=%zu count=%llu\n",
+                   b->pc,
+                   b->pid,
+                   b->container,
+                   i,
+                   b->count);
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <common/defines.h>
+
+// default sampling frequency of the profiler, in Hz.
+#define PROFILE_DEFAULT_FREQUENCY 1000
+
+// number of distinct samples each CPU can keep. Must be a power of two.
+#define PROFILE_NUM_BUCKETS 256
+
+// sampling profiler.
+//
+// on every clock interrupt, the interrupted `ELR_EL1` together with the
+// current pid and container is counted in a per-CPU histogram. Samples are
+// not symbolized in the kernel: feed the output of `profile_dump` and the
+// kernel ELF to `scripts/symbolize.py`.
+
+// clear all histograms and start sampling `frequency` times per second.
+void profile_start(u64 frequency);
+
+// stop sampling. Histograms are kept until the next `profile_start`.
+void profile_stop();
+
+// print the histograms of all CPUs. Call `profile_stop` first.
+void profile_dump();
@@ -0,0 +1,61 @@
+#include <common/spinlock.h>
+#include <core/percpu.h>
+#include <core/rcu.h>
+#include <core/sched.h>
+
+static u64 gp_seq;  // number of the latest grace period started.
+
+// the latest grace period each CPU has seen in a quiescent state.
+static DEFINE_PER_CPU(u64, qs_seq);
+
+static SpinLock lock;  // protects `pending`.
+static ListNode pending;  // callbacks in order of grace periods.
+
+void init_rcu() {
+    init_spinlock(&lock, "rcu");
+    init_list_node(&pending);
+}
+
+void rcu_quiescent() {
+    // reads before the quiescent state must not move past it.
+    u64 seq = __atomic_load_n(&gp_seq, __ATOMIC_ACQUIRE);
+    __atomic_store_n(this_cpu_ptr(&qs_seq), seq, __ATOMIC_RELEASE);
+}
+
+void call_rcu(RcuHead *head, void (*func)(RcuHead *head)) {
+    // the object is unlinked before the grace period starts.
+    head->func = func;
+    head->grace_period = __atomic_add_fetch(&gp_seq, 1, __ATOMIC_SEQ_CST);
+    init_list_node(&head->node);
+
+    acquire_spinlock(&lock);
+    merge_list(pending.prev, &head->node);
+    release_spinlock(&lock);
+}
+
+static bool _elapsed(u64 grace_period) {
+    for (usize i = 0; i < NCPU; i++) {
+        if (__atomic_load_n(per_cpu_ptr(&qs_seq, i), __ATOMIC_ACQUIRE) < grace_period)
+            return false;
+    }
+    return true;
+}
+
+void rcu_poll() {
+    while (__atomic_load_n(&pending.next, __ATOMIC_RELAXED) != &pending) {
+        RcuHead *head = NULL;
+        acquire_spinlock(&lock);
+        if (pending.next != &pending) {
+            head = container_of(pending.next, RcuHead, node);
+            if (_elapsed(head->grace_period))
+                detach_from_list(&head->node);
+            else
+                head = NULL;
+        }
+        release_spinlock(&lock);
+
+        if (head == NULL)
+            return;
+        head->func(head);
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <common/defines.h>
+#include <common/list.h>
+
+// quiescent-state-based RCU.
+//
+// readers walk shared structures without taking locks or writing shared
+// memory. Writers still serialize among themselves with locks; they unlink
+// an object with `detach_from_list_rcu` and hand it to `call_rcu`, which
+// frees it once no reader can hold a pointer to it any more.
+//
+// that is known from quiescent states: a CPU that switches processes in
+// `sched`, or loops in the idle scheduler, is outside every read-side
+// critical section. Once every CPU has passed one since the object was
+// unlinked, a grace period has elapsed.
+//
+// > rcu_read_lock();
+// > Block *b = find(...);  // no sleeping until `rcu_read_unlock`.
+// > rcu_read_unlock();
+
+typedef struct RcuHead {
+    ListNode node;
+    u64 grace_period;  // the grace period to wait for.
+    void (*func)(struct RcuHead *head);
+} RcuHead;
+
+// mark a read-side critical section. They cost nothing: a reader must only
+// not sleep or switch processes inside one.
+static INLINE void rcu_read_lock() {
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static INLINE void rcu_read_unlock() {
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+void init_rcu();
+
+// report that the current CPU holds no pointers found under RCU.
+void rcu_quiescent();
+
+// call `func(head)` after a grace period. `func` runs where `rcu_poll` is
+// called, so it may only take locks that are never held while taking others.
+void call_rcu(RcuHead *head, void (*func)(RcuHead *head));
+
+// run the callbacks whose grace periods have elapsed. Caller must not hold
+// any lock.
+void rcu_poll();
@@ -1,7 +1,13 @@
 #include <common/defines.h>
+#include <common/string.h>
 #include <core/console.h>
 #include <core/container.h>
+#include <core/fpsimd.h>
+#include <core/physical_memory.h>
+#include <core/rcu.h>
 #include <core/sched.h>
+#include <core/timer.h>
+#include <core/trace.h>
 #include <core/virtual_memory.h>
 
 #ifdef MULTI_SCHEDULER
@@ -21,6 +27,17 @@ struct sched_op simple_op = {.scheduler = scheduler_simple,
                              .release_lock = release_ptable_lock};
 struct scheduler simple_scheduler = {.op = &simple_op};
 
+typedef struct {
+    Timer slice_timer;
+    u64 num_switches;
+    u64 total_latency;  // counter ticks from RUNNABLE to RUNNING.
+    u64 max_latency;
+    u64 latency_buckets[SCHED_LATENCY_BUCKETS];  // by log2 of microseconds.
+} SchedCpu;
+
+static DEFINE_PER_CPU(SchedCpu, sched_cpu);
+static u64 slice_ms = SCHED_DEFAULT_SLICE_MS;
+
 void swtch(struct context **, struct context *);
 void to_forkret();
 
@@ -36,57 +53,193 @@ static void release_ptable_lock(struct scheduler *this) {
     release_spinlock(&this->ptable.lock);
 }
 
-/* 
- * Scheduler yields to its parent scheduler.
- * If this == root, just return.
- * Pay attention to thiscpu() structure and locks.
- */
-void yield_scheduler(struct scheduler *this) {
-    if (this->parent) {
-        // printf("\n  ¶¶¶ yield_scheduler: this scheduler : %p\n", this);
-        thiscpu()->scheduler = this->parent;
-        // printf("  ¶¶¶ yield_scheduler: after yield : %p\n", thiscpu()->scheduler);
+// runs on the CPU whose slice expired, in interrupt context.
+static void _slice_expired(Timer *timer) {
+    (void)timer;
+    thiscpu()->need_resched = true;
+}
+
+void init_preemption() {
+    SchedCpu *s = this_cpu_ptr(&sched_cpu);
+    init_timer(&s->slice_timer, _slice_expired, 0, 0);
+}
+
+void set_sched_slice(u64 ms) {
+    assert(ms > 0);
+    slice_ms = ms;
+}
+
+void preempt_if_needed() {
+    struct cpu *c = thiscpu();
+    if (c->need_resched) {
+        c->need_resched = false;
         yield();
     }
-}   
+}
+
+// start the accounting and the time slice of `p`, which is about to run.
+static void _switch_in(proc *p) {
+    SchedCpu *s = this_cpu_ptr(&sched_cpu);
+    u64 now = get_timestamp();
+
+    if (p->runnable_since) {
+        u64 latency = now - p->runnable_since;
+        u64 us = latency * 1000000 / get_clock_frequency();
+        usize bucket = MIN(63 - (usize)__builtin_clzll(us | 1), (usize)SCHED_LATENCY_BUCKETS - 1);
+        s->total_latency += latency;
+        s->max_latency = MAX(s->max_latency, latency);
+        s->latency_buckets[bucket]++;
+        p->runnable_since = 0;
+    }
+    s->num_switches++;
+    p->last_run = now;
+
+    thiscpu()->need_resched = false;
+    timer_arm(&s->slice_timer, slice_ms);
+}
+
+// `p` has just left the CPU. Return how long it ran.
+static u64 _switch_out(proc *p) {
+    timer_cancel(&this_cpu_ptr(&sched_cpu)->slice_timer);
+    u64 delta = get_timestamp() - p->last_run;
+    p->runtime += delta;
+    return delta;
+}
+
+// weight of an entity in its scheduler: containers by their shares, all
+// processes alike.
+static u64 _weight(proc *p) {
+    return p->is_scheduler ? ((container *)p->cont)->shares : SCHED_DEFAULT_SHARES;
+}
+
+// whether `cont` has used up its quota in the current period.
+static bool _throttled(container *cont) {
+    if (cont->quota_ms == 0)
+        return false;
+
+    u64 now = get_timestamp();
+    u64 period = SCHED_PERIOD_MS * (get_clock_frequency() / 1000);
+    u64 start = __atomic_load_n(&cont->period_start, __ATOMIC_RELAXED);
+    if (now - start >= period &&
+        __atomic_compare_exchange_n(
+            &cont->period_start, &start, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&cont->period_usage, 0, __ATOMIC_RELAXED);
+    }
+
+    u64 quota = cont->quota_ms * (get_clock_frequency() / 1000);
+    return __atomic_load_n(&cont->period_usage, __ATOMIC_RELAXED) >= quota;
+}
+
+/*
+ * Pick the runnable entity with the smallest virtual runtime in `this` and
+ * descend into containers until a process is found. Locks nothing, so the
+ * caller must check the result again under its lock.
+ * `*owner` is set to the scheduler whose ptable holds the process.
+ */
+static proc *_pick(struct scheduler *this, struct scheduler **owner) {
+    proc *best = NULL;
+
+    for (usize i = 0; i < NPROC; i++) {
+        proc *p = &this->ptable.proc[i];
+        if (p->state != RUNNABLE || (p->bounding && !(p->bounding & (1 << cpuid()))))
+            continue;
+        if (best && p->vruntime >= best->vruntime)
+            continue;
 
+        if (p->is_scheduler) {
+            container *cont = (container *)p->cont;
+            struct scheduler *leaf_owner;
+            if (_throttled(cont))
+                continue;
+            if (!_pick(&cont->scheduler, &leaf_owner)) {
+                // an idle container must not bank CPU time for later.
+                p->vruntime = MAX(p->vruntime, this->min_vruntime);
+                continue;
+            }
+        }
+        best = p;
+    }
+
+    if (!best)
+        return NULL;
+
+    this->min_vruntime = MAX(this->min_vruntime, best->vruntime);
+    if (best->is_scheduler)
+        return _pick(&((container *)best->cont)->scheduler, owner);
+
+    *owner = this;
+    return best;
+}
+
+// charge `delta` counter ticks of CPU time to `p` and its containers.
+static void _charge(proc *p, struct scheduler *owner, u64 delta) {
+    p->vruntime += delta * SCHED_DEFAULT_SHARES / _weight(p);
+    for (container *cont = owner->cont; cont->p; cont = cont->parent) {
+        __atomic_fetch_add(
+            &cont->p->vruntime, delta * SCHED_DEFAULT_SHARES / cont->shares, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&cont->period_usage, delta, __ATOMIC_RELAXED);
+    }
+}
+
+// put `next`, whose lock we hold, on the CPU.
+static void _run(proc *next, struct scheduler *owner) {
+    struct cpu *c = thiscpu();
+    next->state = RUNNING;
+    c->proc = next;
+    c->scheduler = owner;
+    trace_event(TRACE_SCHED_SWITCH, (u64)next->pid, (u64)container_id(owner->cont));
+    // kernel threads get the boot map: the page table of whoever ran before
+    // them may be freed once that process exits on another CPU.
+    uvm_switch(next->pgdir);
+    fpsimd_switch_in(next);
+    _switch_in(next);
+}
+
+void sched_finish_switch() {
+    struct cpu *c = thiscpu();
+    if (c->prev) {
+        release_spinlock(&c->prev->lock);
+        c->prev = NULL;
+    }
+}
+
+/*
+ * Only the root scheduler loops here. Processes of all containers are
+ * picked by `_pick` and switched to directly, so containers never run
+ * scheduler contexts of their own. Processes also switch to each other
+ * directly in `sched_simple`, so we only get here when a CPU is idle.
+ */
 NO_RETURN void scheduler_simple(struct scheduler *this) {
-    int has_run;
     struct cpu *c = thiscpu();
-    while(1){
-        for (u64 i = 0; i < NPROC; i++) {
-            has_run = 0;
-            proc *p = &this->ptable.proc[i];
-            if (try_acquire_spinlock(&(p->lock))) {
-                if (p->bounding && !(p->bounding & (1 << cpuid()))) {
-                    release_spinlock(&(p->lock));
-                    continue;
-                }
+    assert(this == &root_container->scheduler);
 
-                if (p->state == RUNNABLE) {
-                    // printf("\n  ≤≤≤ [scheduler]: process id (pid:%d)[%p] takes the cpu %d\n", p->pid, p, cpuid());
-                    has_run = 1;
-                    if (!p->is_scheduler) {
-                        p->state = RUNNING;
-                    }
-                    c->proc = p;
-
-                    if (p->is_scheduler) 
-                    {
-                        c->scheduler = &((container *)p->cont)->scheduler;
-                        // printf("\n  ≤≤≤ cpu %d: scheduler CHANGE to : %p\n", cpuid(), c->scheduler);
-                        swtch(&this->context[cpuid()], ((container *)p->cont)->scheduler.context[cpuid()]);
-                    } else {
-                        // printf("  ≤≤≤ cpu %d: will jump to %p [context : %p]\n", cpuid(), p->context->r30, p->context);
-                        uvm_switch(p->pgdir);
-                        swtch(&this->context[cpuid()], p->context);
-                    }
-                }
-                release_spinlock(&(p->lock));
-                if (has_run) 
-                    yield_scheduler(this);
-            }
+    while (1) {
+        timer_poll();
+        rcu_quiescent();
+
+        struct scheduler *owner;
+        proc *p = _pick(this, &owner);
+        if (!p) {
+            // nothing to run: reclaim memory and zero a page for
+            // `kalloc_zeroed` meanwhile.
+            rcu_poll();
+            prezero_page();
+            continue;
         }
+        if (!try_acquire_spinlock(&p->lock))
+            continue;
+        if (p->state != RUNNABLE) {
+            release_spinlock(&p->lock);
+            continue;
+        }
+
+        _run(p, owner);
+        swtch(&this->context[cpuid()], p->context);
+
+        // not necessarily `p`: it may have switched to other processes.
+        release_spinlock(&c->proc->lock);
+        c->proc = NULL;
+        c->scheduler = this;
     }
 }
 
@@ -128,16 +281,42 @@ NO_RETURN void scheduler_simple(struct scheduler *this) {
     }
 } */
 
+/*
+ * Give up the CPU. `this` is the scheduler that owns the current process.
+ *
+ * fast path: pick the next process here and switch to it directly. The lock
+ * of the current process is released by `sched_finish_switch` on the other
+ * side, once we are off its stack. Only when there is nothing else to run
+ * do we fall back to the root scheduler context.
+ */
 static void sched_simple(struct scheduler *this) {
     struct cpu *c = thiscpu();
-    proc * p = c->proc;
-    // printf("\n  ≥≥≥ [sched]: (cpu %d), process: %p yield cpu\n", cpuid(), p);
-    c->proc = ((container *)this->cont)->p;
-    // printf("  ≥≥≥ sched: sched to %p\n", c->proc);
-    if (p->is_scheduler) 
-        swtch(&((container *)p->cont)->scheduler.context[cpuid()], c->scheduler->context[cpuid()]);
-    else
-        swtch(&p->context, c->scheduler->context[cpuid()]);
+    proc *prev = c->proc;
+    rcu_quiescent();
+    _charge(prev, this, _switch_out(prev));
+
+    struct scheduler *owner;
+    proc *next = _pick(&root_container->scheduler, &owner);
+    if (next == prev) {
+        // yielded, but still the best choice.
+        _run(prev, this);
+        return;
+    }
+    fpsimd_switch_out(prev);
+
+    if (next && try_acquire_spinlock(&next->lock)) {
+        if (next->state == RUNNABLE) {
+            _run(next, owner);
+            c->prev = prev;
+            swtch(&prev->context, next->context);
+            sched_finish_switch();
+            return;
+        }
+        release_spinlock(&next->lock);
+    }
+
+    swtch(&prev->context, root_container->scheduler.context[cpuid()]);
+    sched_finish_switch();
 }
 
 static struct proc *alloc_pcb_simple(struct scheduler *this) {
@@ -148,6 +327,7 @@ static struct proc *alloc_pcb_simple(struct scheduler *this) {
                 p = &this->ptable.proc[i];
                 memset(p, 0, sizeof(proc));
                 p->state=EMBRYO;
+                p->vruntime = this->min_vruntime;
                 p->pid = *(int *)alloc_resource((container *)this->cont, p, PID);
                 break;
             }
@@ -157,4 +337,43 @@ static struct proc *alloc_pcb_simple(struct scheduler *this) {
     return p;
 }
 
+static void _dump_procs(struct scheduler *this) {
+    u64 frequency = get_clock_frequency();
+    for (usize i = 0; i < NPROC; i++) {
+        proc *p = &this->ptable.proc[i];
+        if (p->state == UNUSED)
+            continue;
+        printf("  pid %d container %d: state %d, runtime %llu us\n",
+               p->pid,
+               container_id(this->cont),
+               p->state,
+               p->runtime * 1000000 / frequency);
+        if (p->is_scheduler)
+            _dump_procs(&((container *)p->cont)->scheduler);
+    }
+}
+
+void sched_dump_stats() {
+    u64 frequency = get_clock_frequency();
+    for (usize i = 0; i < NCPU; i++) {
+        SchedCpu *s = per_cpu_ptr(&sched_cpu, i);
+        printf("- sched stats: cpu=%zu switches=%llu avg_latency=%llu us max_latency=%llu us\n",
+               i,
+               s->num_switches,
+               s->num_switches ? s->total_latency * 1000000 / frequency / s->num_switches : 0,
+               s->max_latency * 1000000 / frequency);
+        for (usize j = 0; j < SCHED_LATENCY_BUCKETS; j++) {
+            if (!s->latency_buckets[j])
+                continue;
+            // the last bucket takes everything above.
+            if (j == SCHED_LATENCY_BUCKETS - 1)
+                printf("  latency >= %llu us: %llu\n", 1ull << j, s->latency_buckets[j]);
+            else
+                printf("  latency < %llu us: %llu\n", 2ull << j, s->latency_buckets[j]);
+        }
+    }
+    printf("- sched stats: processes\n");
+    _dump_procs(&root_container->scheduler);
+}
+
 #endif
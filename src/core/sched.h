@@ -4,6 +4,7 @@
 #include <common/defines.h>
 #include <common/spinlock.h>
 #include <core/console.h>
+#include <core/percpu.h>
 #include <core/proc.h>
 
 #define MULTI_SCHEDULER
@@ -44,10 +45,10 @@ struct cpu {
     struct proc *proc;
 };
 #define NCPU 4 /* maximum number of CPUs */
-extern struct cpu cpus[NCPU];
+DECLARE_PER_CPU(struct cpu, cpus);
 
 static INLINE struct cpu *thiscpu() {
-    return &cpus[cpuid()];
+    return this_cpu_ptr(&cpus);
 }
 
 static INLINE void init_sched() {
@@ -110,16 +111,19 @@ struct scheduler {
     int pid;
     struct scheduler *parent;
     struct container *cont;
+    u64 min_vruntime;  /* never decreases; where new entities start */
 };
 
 struct cpu {
     struct scheduler *scheduler;
     struct proc *proc;
+    bool need_resched;  /* proc should yield before returning to user space */
+    struct proc *prev;  /* switched out, lock to be released by the next proc */
 };
-extern struct cpu cpus[NCPU];
+DECLARE_PER_CPU(struct cpu, cpus);
 
 static INLINE struct cpu *thiscpu() {
-    return &cpus[cpuid()];
+    return this_cpu_ptr(&cpus);
 }
 
 static INLINE void init_sched() {
@@ -127,6 +131,33 @@ static INLINE void init_sched() {
     // simple_scheduler.op->init();
 }
 
+/* weight of a process, and default shares of a container. */
+#define SCHED_DEFAULT_SHARES 1024
+
+/* container quotas are enforced over periods of this length. */
+#define SCHED_PERIOD_MS 100
+
+/* default length of a time slice, in milliseconds. */
+#define SCHED_DEFAULT_SLICE_MS 10
+
+/* number of buckets of the scheduling latency histogram. */
+#define SCHED_LATENCY_BUCKETS 16
+
+/* set up time slices on this CPU. */
+void init_preemption();
+
+/* change the length of time slices. Takes effect at the next switch. */
+void set_sched_slice(u64 slice_ms);
+
+/* first thing a process does after it is switched in. */
+void sched_finish_switch();
+
+/* yield if the time slice of the current process has expired. */
+void preempt_if_needed();
+
+/* print scheduling latency of every CPU and runtime of every process. */
+void sched_dump_stats();
+
 static INLINE void init_cpu(struct scheduler *scheduler) {
     thiscpu()->scheduler = scheduler;
     //     init_sched();
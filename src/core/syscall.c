@@ -1,28 +1,116 @@
 #include <core/console.h>
+#include <core/percpu.h>
 #include <core/proc.h>
+#include <core/sched.h>
 #include <core/syscall.h>
 #include <core/syscallno.h>
 
+// every syscall takes up to six arguments from x0~x5 and returns in x0.
+typedef u64 (*SyscallHandler)(u64, u64, u64, u64, u64, u64);
+
+typedef struct {
+    SyscallHandler handler;
+    const char *name;
+} SyscallEntry;
+
+// adapt `sys_<ident>` to `SyscallHandler`, passing it the arguments `...`
+// built from `a0`~`a5`.
+#define SYSCALL_WRAPPER(ident, ...)                                            \
+    static u64 _sys_##ident(u64 a0, u64 a1, u64 a2, u64 a3, u64 a4, u64 a5) { \
+        (void)a0, (void)a1, (void)a2, (void)a3, (void)a4, (void)a5;            \
+        return sys_##ident(__VA_ARGS__);                                       \
+    }
+
+SYSCALL_WRAPPER(myexecve, (char *)a0)
+SYSCALL_WRAPPER(myprint, (int)a0)
+SYSCALL_WRAPPER(myyield)
+SYSCALL_WRAPPER(mygetpid)
+SYSCALL_WRAPPER(myring_setup)
+SYSCALL_WRAPPER(myring_enter)
+SYSCALL_WRAPPER(mysbrk, a0)
+SYSCALL_WRAPPER(myfork)
+SYSCALL_WRAPPER(mymmap, (usize)a0, a1, a2, (bool)a3)
+SYSCALL_WRAPPER(mymunmap, a0)
+
+#undef SYSCALL_WRAPPER
+
+// `sys_myexit` does not return anything.
+static u64 _sys_myexit(u64 a0, u64 a1, u64 a2, u64 a3, u64 a4, u64 a5) {
+    (void)a0, (void)a1, (void)a2, (void)a3, (void)a4, (void)a5;
+    sys_myexit();
+}
+
+#define SYSCALL(ident) [SYS_##ident] = {_sys_##ident, #ident}
+
+static const SyscallEntry syscall_table[NR_SYSCALL] = {
+    SYSCALL(myexecve),
+    SYSCALL(myexit),
+    SYSCALL(myprint),
+    SYSCALL(myyield),
+    SYSCALL(mygetpid),
+    SYSCALL(myring_setup),
+    SYSCALL(myring_enter),
+    SYSCALL(mysbrk),
+    SYSCALL(myfork),
+    SYSCALL(mymmap),
+    SYSCALL(mymunmap),
+};
+
+#undef SYSCALL
+
+typedef struct {
+    u64 count[NR_SYSCALL];
+} SyscallStats;
+
+static DEFINE_PER_CPU(SyscallStats, syscall_stats);
+
 /*
  * Based on the syscall number, call the corresponding syscall handler.
  * The syscall number and parameters are all stored in the trapframe.
  * See `syscallno.h` for syscall number macros.
+ *
+ * NOTE: called from the fast path in `trap.S`, so `frame->r19`~`frame->r29`
+ * are not valid here, except for `SYS_myfork`.
  */
 void syscall_dispatch(Trapframe *frame) {
-    /* : Lab3 Syscall */
-    u64 sysnum = frame -> r8;
-    switch(sysnum) {
-    case SYS_myexecve:
-        sys_myexecve((char *)(frame->r0));
-        break;
-    case SYS_myexit:
-        sys_myexit();
-        break;
-    case SYS_myprint:
-        sys_myprint(frame->r0);
-        break;
-    default:
-        PANIC("Unknown syscall number.");
-        break;
+    u64 sysnum = frame->r8;
+    if (sysnum >= NR_SYSCALL || !syscall_table[sysnum].handler) {
+        printf("(warn) syscall_dispatch: unknown syscall %llu\n", sysnum);
+        frame->r0 = (u64)-1;
+        return;
+    }
+
+    this_cpu_ptr(&syscall_stats)->count[sysnum]++;
+    frame->r0 = syscall_table[sysnum].handler(
+        frame->r0, frame->r1, frame->r2, frame->r3, frame->r4, frame->r5);
+}
+
+// used by the submission rings in `uring.c`. `SYS_myfork` needs the
+// trapframe of a real system call, so it cannot be queued.
+u64 syscall_invoke(u64 sysnum, u64 args[6]) {
+    if (sysnum >= NR_SYSCALL || !syscall_table[sysnum].handler) {
+        printf("(warn) syscall_invoke: unknown syscall %llu\n", sysnum);
+        return (u64)-1;
+    }
+    if (sysnum == SYS_myfork) {
+        printf("(warn) syscall_invoke: %s not allowed from a ring\n", syscall_table[sysnum].name);
+        return (u64)-1;
+    }
+
+    this_cpu_ptr(&syscall_stats)->count[sysnum]++;
+    return syscall_table[sysnum].handler(args[0], args[1], args[2], args[3], args[4], args[5]);
+}
+
+void syscall_dump_stats() {
+    printf("- syscall stats:\n");
+    for (usize i = 0; i < NR_SYSCALL; i++) {
+        if (!syscall_table[i].handler)
+            continue;
+
+        u64 count = 0;
+        for (usize j = 0; j < NCPU; j++) {
+            count += per_cpu_ptr(&syscall_stats, j)->count[i];
+        }
+        printf("  %s (%zu): %llu\n", syscall_table[i].name, i, count);
     }
 }
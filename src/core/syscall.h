@@ -3,7 +3,23 @@
 #include <core/syscallno.h>
 #include <core/trapframe.h>
 
-void sys_myexecve(char *s);
+u64 sys_myexecve(char *s);
 NO_RETURN void sys_myexit();
-void sys_myprint(int x);
+u64 sys_myprint(int x);
+u64 sys_myyield();
+u64 sys_mygetpid();
+u64 sys_myring_setup();
+u64 sys_myring_enter();
+u64 sys_mysbrk(u64 increment);
+u64 sys_myfork();
+u64 sys_mymmap(usize inode_no, u64 offset, u64 length, bool writable);
+u64 sys_mymunmap(u64 addr);
+
 void syscall_dispatch(Trapframe *frame);
+
+// call the handler of `sysnum` with `args`. Return -1 for unknown syscalls,
+// and for those that cannot be queued on a ring (`SYS_myfork`).
+u64 syscall_invoke(u64 sysnum, u64 args[6]);
+
+// print how many times each syscall has been made, summed over all CPUs.
+void syscall_dump_stats();
@@ -4,3 +4,13 @@
 #define SYS_myexit   457
 #define SYS_myprint  458
 #define SYS_myyield  459
+#define SYS_mygetpid 460
+#define SYS_myring_setup 461
+#define SYS_myring_enter 462
+#define SYS_mysbrk 463
+#define SYS_myfork 464
+#define SYS_mymmap 465
+#define SYS_mymunmap 466
+
+// size of the syscall table. Syscall numbers must be smaller than it.
+#define NR_SYSCALL 512
@@ -1,11 +1,14 @@
 #include <core/console.h>
 #include <core/cpu.h>
+#include <core/mmap.h>
 #include <core/proc.h>
 #include <core/syscall.h>
+#include <core/uring.h>
+#include <core/virtual_memory.h>
 
-void sys_myexecve(char *s) {
+u64 sys_myexecve(char *s) {
     printf("sys_exec: executing %s\n", s);
-    return;
+    return 0;
 }
 
 void sys_myexit() {
@@ -16,14 +19,56 @@ void sys_myexit() {
 /* myprint(int x) =>
             printf("pid %d, pid in root %d, cnt %d\n", getpid(), getrootpid(), x);
             yield(); */
-void sys_myprint(int x) {
-    int rootpid = -1;
-    for (int i = 0; i < NPID; i++) {
-        if (root_container->pmap[i].valid && root_container->pmap[i].p == thiscpu()->proc) {
-            rootpid = root_container->pmap[i].pid_local;
-        }
-    }
+u64 sys_myprint(int x) {
+    int rootpid = root_pid(thiscpu()->proc);
     assert(rootpid > 0);
     printf("pid %d, pid in root %d, cnt %d\n", thiscpu()->proc->pid, rootpid, x);
     yield();
+    return 0;
+}
+
+u64 sys_myyield() {
+    yield();
+    return 0;
+}
+
+u64 sys_mygetpid() {
+    return (u64)thiscpu()->proc->pid;
+}
+
+u64 sys_myring_setup() {
+    return uring_setup(thiscpu()->proc);
+}
+
+/* drain the submission ring, return the number of completions posted. */
+u64 sys_myring_enter() {
+    return (u64)uring_drain(thiscpu()->proc);
+}
+
+/*
+ * grow the heap by `increment` bytes and return the old break, or -1.
+ * Only the break moves: pages are allocated on first touch. The heap never
+ * shrinks.
+ */
+u64 sys_mysbrk(u64 increment) {
+    struct proc *p = thiscpu()->proc;
+    if (increment > USER_MMAP_BASE - p->sz)
+        return (u64)-1;
+    u64 old = p->sz;
+    p->sz += increment;
+    return old;
+}
+
+/* return the pid of the child to the parent, and 0 to the child. */
+u64 sys_myfork() {
+    return (u64)fork();
+}
+
+/* map a regular file, return the user address or -1. See `mmap.h`. */
+u64 sys_mymmap(usize inode_no, u64 offset, u64 length, bool writable) {
+    return mmap_file(thiscpu()->proc, inode_no, offset, length, writable);
+}
+
+u64 sys_mymunmap(u64 addr) {
+    return (u64)munmap_file(thiscpu()->proc, addr);
 }
@@ -0,0 +1,332 @@
+#include <aarch64/intrinsic.h>
+#include <common/spinlock.h>
+#include <core/console.h>
+#include <core/percpu.h>
+#include <core/proc.h>
+#include <core/sched.h>
+#include <core/timer.h>
+#include <driver/clock.h>
+
+#define WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+
+// number of jiffies covered by one slot of `level`.
+#define LEVEL_SPAN(level) (1ull << ((level)*TIMER_WHEEL_BITS))
+
+// timers further away than this are parked in the last level and checked
+// again when they reach level 0.
+#define MAX_DELTA (LEVEL_SPAN(TIMER_WHEEL_LEVELS) - 1)
+
+typedef struct TimerBase {
+    SpinLock lock;
+    u64 clk;  // the next jiffy to be processed.
+    u64 pending[TIMER_WHEEL_LEVELS];  // bitmap of non-empty slots.
+    ListNode wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+    ListNode deferred;  // expired `TIMER_DEFERRED` timers.
+} TimerBase;
+
+static DEFINE_PER_CPU(TimerBase, timer_base);
+static u64 ticks_per_jiffy;
+
+static void timer_interrupt();
+
+u64 timer_jiffies() {
+    return get_timestamp() / ticks_per_jiffy;
+}
+
+void init_timers() {
+    TimerBase *base = this_cpu_ptr(&timer_base);
+    init_spinlock(&base->lock, "timer");
+    for (usize i = 0; i < TIMER_WHEEL_LEVELS; i++) {
+        base->pending[i] = 0;
+        for (usize j = 0; j < TIMER_WHEEL_SIZE; j++) {
+            init_list_node(&base->wheel[i][j]);
+        }
+    }
+    init_list_node(&base->deferred);
+
+    ticks_per_jiffy = get_clock_frequency() / 1000 * TIMER_JIFFY_MS;
+    base->clk = timer_jiffies();
+    set_clock_event_handler(timer_interrupt);
+}
+
+void init_timer(Timer *timer, TimerCallback callback, u64 data, u32 flags) {
+    init_list_node(&timer->node);
+    timer->expires = 0;
+    timer->callback = callback;
+    timer->data = data;
+    timer->flags = flags;
+    timer->armed = false;
+    timer->base = NULL;
+}
+
+// caller must hold `base->lock`.
+static void _enqueue(TimerBase *base, Timer *timer) {
+    u64 expires = MAX(timer->expires, base->clk);
+    u64 delta = MIN(expires - base->clk, MAX_DELTA);
+    expires = base->clk + delta;
+
+    usize level = 0;
+    while (delta >= LEVEL_SPAN(level + 1)) {
+        level++;
+    }
+    usize slot = (expires >> (level * TIMER_WHEEL_BITS)) & WHEEL_MASK;
+
+    merge_list(&base->wheel[level][slot], &timer->node);
+    base->pending[level] |= 1ull << slot;
+    timer->base = base;
+}
+
+// caller must hold `base->lock`.
+static void _dequeue(TimerBase *base, Timer *timer) {
+    ListNode *prev = timer->node.prev;
+    detach_from_list(&timer->node);
+
+    // the timer was alone in its slot iff `prev` is now an empty list head.
+    for (usize level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        ListNode *head = &base->wheel[level][0];
+        if (prev >= head && prev < head + TIMER_WHEEL_SIZE) {
+            if (prev->next == prev)
+                base->pending[level] &= ~(1ull << (prev - head));
+            break;
+        }
+    }
+}
+
+// take `timer` off the wheels or the deferred list of `base`.
+// caller must hold `base->lock`.
+static void _detach(TimerBase *base, Timer *timer) {
+    if (timer->armed)
+        _dequeue(base, timer);
+    else
+        detach_from_list(&timer->node);
+    timer->armed = false;
+    timer->base = NULL;
+}
+
+// jiffy at which the first non-empty slot of `level` is due: expired for
+// level 0, cascaded otherwise. It may be early, never late.
+static u64 _level_due(TimerBase *base, usize level) {
+    u64 span = LEVEL_SPAN(level);
+    u64 clk = (base->clk + span - 1) & ~(span - 1);
+    usize index = (clk >> (level * TIMER_WHEEL_BITS)) & WHEEL_MASK;
+
+    u64 rotated = (base->pending[level] >> index) |
+                  (index ? base->pending[level] << (TIMER_WHEEL_SIZE - index) : 0);
+    return clk + (u64)__builtin_ctzll(rotated) * span;
+}
+
+// program the earliest deadline into the physical timer.
+// caller must hold `base->lock`.
+static void _program(TimerBase *base) {
+    u64 due = (u64)-1;
+    for (usize level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        if (base->pending[level])
+            due = MIN(due, _level_due(base, level));
+    }
+
+    set_clock_event(due == (u64)-1 ? due : due * ticks_per_jiffy);
+}
+
+// move all timers in a slot of `level` one level down or more.
+// caller must hold `base->lock`.
+static void _cascade(TimerBase *base, usize level) {
+    usize slot = (base->clk >> (level * TIMER_WHEEL_BITS)) & WHEEL_MASK;
+    ListNode *head = &base->wheel[level][slot];
+    base->pending[level] &= ~(1ull << slot);
+
+    // detach the whole slot first: a timer may land in the same slot again.
+    ListNode *node = head->next;
+    if (node == head)
+        return;
+    detach_from_list(head);
+
+    while (node) {
+        ListNode *next = detach_from_list(node);
+        _enqueue(base, container_of(node, Timer, node));
+        node = next;
+    }
+}
+
+// collect timers due at or before `now` into `expired`. They stay owned by
+// `base` there, unarmed, like timers on the deferred list.
+// caller must hold `base->lock`.
+static void _advance(TimerBase *base, u64 now, ListNode *expired) {
+    while (base->clk <= now) {
+        // cascade from the coarsest level whose slot starts here.
+        usize top = 0;
+        while (top + 1 < TIMER_WHEEL_LEVELS && (base->clk & (LEVEL_SPAN(top + 1) - 1)) == 0) {
+            top++;
+        }
+        for (usize level = top; level > 0; level--) {
+            _cascade(base, level);
+        }
+
+        usize index = base->clk & WHEEL_MASK;
+        ListNode *head = &base->wheel[0][index];
+        base->pending[0] &= ~(1ull << index);
+        while (head->next != head) {
+            Timer *timer = container_of(head->next, Timer, node);
+            detach_from_list(&timer->node);
+            if (timer->expires > base->clk) {
+                // parked by `MAX_DELTA`, and not due yet.
+                _enqueue(base, timer);
+                continue;
+            }
+            // keep `base`: until it is popped under the lock, the timer
+            // can still be cancelled or re-armed from the `expired` list.
+            timer->armed = false;
+            merge_list(expired->prev, &timer->node);
+        }
+        base->clk++;
+
+        // jump over the jiffies where there is nothing to do.
+        u64 due = now + 1;
+        for (usize level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+            if (base->pending[level])
+                due = MIN(due, _level_due(base, level));
+        }
+        base->clk = MAX(base->clk, due);
+    }
+}
+
+void timer_arm(Timer *timer, u64 timeout_ms) {
+    TimerBase *base = this_cpu_ptr(&timer_base);
+
+    // re-arming may move the timer to this CPU.
+    while (true) {
+        TimerBase *old = __atomic_load_n(&timer->base, __ATOMIC_ACQUIRE);
+        if (!old || old == base)
+            break;
+        // the other CPU may wake up for nothing, and then reprogram.
+        acquire_spinlock(&old->lock);
+        if (timer->base == old)
+            _detach(old, timer);
+        release_spinlock(&old->lock);
+    }
+
+    acquire_spinlock(&base->lock);
+    if (timer->base == base)
+        _detach(base, timer);
+    // round up, so that the timer never fires early.
+    u64 deadline = get_timestamp() + timeout_ms * (ticks_per_jiffy / TIMER_JIFFY_MS);
+    timer->expires = (deadline + ticks_per_jiffy - 1) / ticks_per_jiffy;
+    timer->armed = true;
+    _enqueue(base, timer);
+    _program(base);
+    release_spinlock(&base->lock);
+}
+
+bool timer_cancel(Timer *timer) {
+    while (true) {
+        TimerBase *base = __atomic_load_n(&timer->base, __ATOMIC_ACQUIRE);
+        if (!base)
+            return false;
+        acquire_spinlock(&base->lock);
+        if (timer->base == base) {
+            // not armed but with a base: expired and waiting in the
+            // expired or deferred list.
+            bool armed = timer->armed;
+            _detach(base, timer);
+            release_spinlock(&base->lock);
+            return armed;
+        }
+        release_spinlock(&base->lock);
+    }
+}
+
+// run expired timers of the current CPU. Deferred callbacks run here only
+// if `run_deferred` is set.
+static void _run_timers(bool run_deferred) {
+    TimerBase *base = this_cpu_ptr(&timer_base);
+    ListNode expired;
+    init_list_node(&expired);
+
+    acquire_spinlock(&base->lock);
+    _advance(base, timer_jiffies(), &expired);
+
+    while (expired.next != &expired) {
+        Timer *timer = container_of(expired.next, Timer, node);
+        detach_from_list(&timer->node);
+        if (timer->flags & TIMER_DEFERRED) {
+            merge_list(base->deferred.prev, &timer->node);
+            continue;
+        }
+        timer->base = NULL;
+
+        release_spinlock(&base->lock);
+        timer->callback(timer);
+        acquire_spinlock(&base->lock);
+    }
+
+    while (run_deferred && base->deferred.next != &base->deferred) {
+        Timer *timer = container_of(base->deferred.next, Timer, node);
+        detach_from_list(&timer->node);
+        timer->base = NULL;
+
+        release_spinlock(&base->lock);
+        timer->callback(timer);
+        acquire_spinlock(&base->lock);
+    }
+
+    _program(base);
+    release_spinlock(&base->lock);
+}
+
+// called by `invoke_clock_handler` once the programmed deadline has passed.
+static void timer_interrupt() {
+    _run_timers(false);
+}
+
+void timer_poll() {
+    _run_timers(true);
+}
+
+static void _wakeup_sleeper(Timer *timer) {
+    wakeup(timer);
+}
+
+void timer_sleep(u64 timeout_ms) {
+    Timer timer;
+    init_timer(&timer, _wakeup_sleeper, 0, 0);
+
+    // the timer fires on this CPU, which cannot take the interrupt until we
+    // are switched out, so there is no lost wakeup.
+    timer_arm(&timer, timeout_ms);
+    while (timer.armed) {
+        sleep(&timer, NULL);
+    }
+}
+
+static void _test_callback(Timer *timer) {
+    (*(u64 *)timer->data)++;
+}
+
+void timer_test() {
+    enum { NUM_TIMERS = 64 };
+    static Timer timers[NUM_TIMERS];
+    u64 count = 0;
+
+    // spread timers over the levels, then cancel and re-arm some of them.
+    for (usize i = 0; i < NUM_TIMERS; i++) {
+        init_timer(&timers[i], _test_callback, (u64)&count, 0);
+        timer_arm(&timers[i], 1 + i * i * 3);
+    }
+    for (usize i = 0; i < NUM_TIMERS; i += 4) {
+        assert(timer_cancel(&timers[i]));
+        assert(!timer_cancel(&timers[i]));
+    }
+    for (usize i = 0; i < NUM_TIMERS; i += 8) {
+        timer_arm(&timers[i], 5);
+    }
+
+    u64 start = timer_jiffies();
+    u64 expected = NUM_TIMERS - NUM_TIMERS / 4 + NUM_TIMERS / 8;
+    while (count < expected) {
+        timer_poll();
+        assert(timer_jiffies() - start < 20000);
+    }
+    for (usize i = 0; i < NUM_TIMERS; i++) {
+        assert(!timers[i].armed);
+    }
+    printf("timer_test PASS: %llu timers in %llu jiffies\n", count, timer_jiffies() - start);
+}
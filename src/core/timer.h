@@ -0,0 +1,72 @@
+#pragma once
+
+#include <common/defines.h>
+#include <common/list.h>
+
+// hierarchical timer wheels.
+//
+// every CPU owns `TIMER_WHEEL_LEVELS` wheels of `TIMER_WHEEL_SIZE` slots. A
+// slot of level `l` spans `TIMER_WHEEL_SIZE^l` jiffies, so a timer is kept
+// at a coarse level while its deadline is far away and moved ("cascaded")
+// to finer levels as the deadline comes closer. Arming and cancelling a
+// timer is a list operation in O(1).
+//
+// there is no periodic tick: only the earliest deadline on each CPU is
+// programmed into the physical timer.
+//
+// callbacks run on the CPU that armed the timer, without the wheel lock, so
+// they may re-arm their own timer. By default they run in interrupt context
+// and must not sleep. Timers with `TIMER_DEFERRED` are instead run by
+// `timer_poll` on that CPU, on the way back to user space or when it has
+// nothing to run, and may take longer.
+
+// length of one jiffy, the resolution of timers, in milliseconds.
+#define TIMER_JIFFY_MS 1
+
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SIZE   (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+// `Timer.flags`.
+#define TIMER_DEFERRED 1
+
+struct Timer;
+struct TimerBase;
+
+typedef void (*TimerCallback)(struct Timer *timer);
+
+typedef struct Timer {
+    ListNode node;
+    u64 expires;  // in jiffies.
+    TimerCallback callback;
+    u64 data;  // free for the owner of the timer.
+    u32 flags;
+    bool armed;
+    struct TimerBase *base;  // the wheels the timer is armed or expiring on.
+} Timer;
+
+// set up the wheels of the current CPU.
+void init_timers();
+
+void init_timer(Timer *timer, TimerCallback callback, u64 data, u32 flags);
+
+// let `timer` fire after `timeout_ms` milliseconds. An armed timer is moved
+// to the new deadline.
+void timer_arm(Timer *timer, u64 timeout_ms);
+
+// disarm `timer`. Return false if it was not armed. It does not wait for a
+// callback that is already running.
+bool timer_cancel(Timer *timer);
+
+// current time in jiffies.
+u64 timer_jiffies();
+
+// run expired timers and deferred callbacks of the current CPU. Called before
+// returning from interrupts to user space, and from the scheduler loop so
+// that idle CPUs do not depend on interrupts.
+void timer_poll();
+
+// sleep for at least `timeout_ms` milliseconds.
+void timer_sleep(u64 timeout_ms);
+
+void timer_test();
@@ -0,0 +1,145 @@
+#include <aarch64/intrinsic.h>
+#include <core/console.h>
+#include <core/percpu.h>
+#include <core/physical_memory.h>
+#include <core/proc.h>
+#include <core/sched.h>
+#include <core/trace.h>
+
+typedef struct {
+    u64 head;  // number of slots ever reserved.
+    TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+static DEFINE_PER_CPU(TraceRing, trace_ring);
+static bool enabled;
+
+// how to decode each event type. A NULL argument name means it is unused.
+static const struct {
+    const char *name;
+    const char *args[2];
+} event_info[NUM_TRACE_EVENTS] = {
+    [TRACE_SCHED_SWITCH] = {"sched_switch", {"pid", "container"}},
+    [TRACE_SLEEP] = {"sleep", {"chan", NULL}},
+    [TRACE_WAKEUP] = {"wakeup", {"chan", NULL}},
+    [TRACE_BCACHE_ACQUIRE] = {"bcache_acquire", {"block_no", "hit"}},
+    [TRACE_BCACHE_COMMIT] = {"bcache_commit", {"num_blocks", NULL}},
+    [TRACE_SD_START] = {"sd_start", {"block_no", "flags"}},
+    [TRACE_SD_INTR] = {"sd_intr", {"interrupt", NULL}},
+    [TRACE_KALLOC] = {"kalloc", {"page", "num_pages"}},
+    [TRACE_KFREE] = {"kfree", {"page", "num_pages"}},
+};
+
+void trace_start() {
+    __atomic_store_n(&enabled, true, __ATOMIC_RELEASE);
+}
+
+void trace_stop() {
+    __atomic_store_n(&enabled, false, __ATOMIC_RELEASE);
+}
+
+void trace_event(TraceEventType type, u64 arg0, u64 arg1) {
+    if (!__atomic_load_n(&enabled, __ATOMIC_RELAXED))
+        return;
+
+    // the increment is atomic, so the slot is ours even if we are preempted
+    // or migrated right after `this_cpu_ptr`.
+    TraceRing *ring = this_cpu_ptr(&trace_ring);
+    u64 slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    TraceEvent *event = &ring->events[slot & (TRACE_RING_SIZE - 1)];
+
+    __atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    struct proc *p = thiscpu()->proc;
+    event->timestamp = get_virtual_timestamp();
+    event->type = (u16)type;
+    event->pid = p ? (u16)p->pid : 0;
+    event->args[0] = arg0;
+    event->args[1] = arg1;
+
+    __atomic_store_n(&event->seq, (u32)(slot + 1), __ATOMIC_RELEASE);
+}
+
+// copy the record in `slot` out of `ring`. Return false if it has been
+// overwritten or is still being written.
+static bool _read_event(TraceRing *ring, u64 slot, TraceEvent *out) {
+    TraceEvent *event = &ring->events[slot & (TRACE_RING_SIZE - 1)];
+    u32 seq = __atomic_load_n(&event->seq, __ATOMIC_ACQUIRE);
+    if (seq != (u32)(slot + 1))
+        return false;
+
+    *out = *event;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&event->seq, __ATOMIC_RELAXED) == seq;
+}
+
+void trace_dump() {
+    u64 next[NCPU], end[NCPU];
+    for (usize i = 0; i < NCPU; i++) {
+        TraceRing *ring = per_cpu_ptr(&trace_ring, i);
+        end[i] = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        next[i] = end[i] > TRACE_RING_SIZE ? end[i] - TRACE_RING_SIZE : 0;
+    }
+
+    printf("- trace dump: counter frequency %llu Hz\n", get_clock_frequency());
+
+    // merge the rings of all CPUs by timestamp.
+    usize num_events = 0, num_dropped = 0;
+    u64 first_timestamp = 0;
+    while (true) {
+        TraceEvent oldest, event;
+        isize oldest_cpu = -1;
+        for (usize i = 0; i < NCPU; i++) {
+            TraceRing *ring = per_cpu_ptr(&trace_ring, i);
+            while (next[i] < end[i] && !_read_event(ring, next[i], &event)) {
+                next[i]++;
+                num_dropped++;
+            }
+            if (next[i] < end[i] &&
+                (oldest_cpu < 0 || event.timestamp < oldest.timestamp)) {
+                oldest = event;
+                oldest_cpu = (isize)i;
+            }
+        }
+        if (oldest_cpu < 0)
+            break;
+        next[oldest_cpu]++;
+
+        if (num_events++ == 0)
+            first_timestamp = oldest.timestamp;
+        asserts(oldest.type < NUM_TRACE_EVENTS, "unknown trace event %d", oldest.type);
+
+        printf("  +%llu cpu %lld pid %d %s",
+               oldest.timestamp - first_timestamp,
+               oldest_cpu,
+               (i32)oldest.pid,
+               event_info[oldest.type].name);
+        for (usize j = 0; j < 2; j++) {
+            if (event_info[oldest.type].args[j])
+                printf(" %s=0x%llx", event_info[oldest.type].args[j], oldest.args[j]);
+        }
+        printf("\n");
+    }
+
+    printf("- trace dump: %zu events, %zu dropped\n", num_events, num_dropped);
+}
+
+// measure the cost of a tracepoint and dump what it recorded.
+void trace_test() {
+    enum { NUM_ROUNDS = 10000 };
+
+    trace_start();
+    u64 t = get_timestamp();
+    for (usize i = 0; i < NUM_ROUNDS; i++) {
+        trace_event(TRACE_WAKEUP, i, 0);
+    }
+    u64 cycles = get_timestamp() - t;
+
+    void *page = kalloc();
+    kfree(page);
+    trace_stop();
+
+    trace_dump();
+    printf("- trace test: %d events in %llu counter ticks\n", NUM_ROUNDS, cycles);
+}
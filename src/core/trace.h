@@ -0,0 +1,46 @@
+#pragma once
+
+#include <common/defines.h>
+
+// number of events kept by each CPU. Must be a power of two.
+#define TRACE_RING_SIZE 256
+
+typedef enum {
+    TRACE_SCHED_SWITCH,    // args: pid of the next process, is it a scheduler?
+    TRACE_SLEEP,           // args: channel.
+    TRACE_WAKEUP,          // args: channel.
+    TRACE_BCACHE_ACQUIRE,  // args: block number, was it cached?
+    TRACE_BCACHE_COMMIT,   // args: number of logged blocks.
+    TRACE_SD_START,        // args: block number, buffer flags.
+    TRACE_SD_INTR,         // args: `EMMC_INTERRUPT`.
+    TRACE_KALLOC,          // args: page address, number of pages.
+    TRACE_KFREE,           // args: page address, number of pages.
+
+    NUM_TRACE_EVENTS,
+} TraceEventType;
+
+// a binary trace record. Decoding is deferred to `trace_dump`.
+typedef struct {
+    u64 timestamp;  // `cntvct_el0` when the event was recorded.
+    u32 seq;        // slot index plus one, or zero while the record is written.
+    u16 type;       // `TraceEventType`.
+    u16 pid;        // the current process, zero if there is none.
+    u64 args[2];
+} TraceEvent;
+
+// start/stop recording events. Tracing is off after boot.
+void trace_start();
+void trace_stop();
+
+// record an event on the current CPU.
+//
+// the per-CPU ring has no lock: a slot is reserved with an atomic increment
+// so that interrupt handlers can trace on top of the code they preempted,
+// and the oldest records are overwritten silently.
+void trace_event(TraceEventType type, u64 arg0, u64 arg1);
+
+// print all recorded events of all CPUs in timestamp order.
+// tracing should be stopped before dumping.
+void trace_dump();
+
+void trace_test();
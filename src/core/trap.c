@@ -1,9 +1,15 @@
 #include <aarch64/arm.h>
 #include <aarch64/intrinsic.h>
 #include <core/console.h>
+#include <core/fpsimd.h>
+#include <core/page_fault.h>
 #include <core/proc.h>
+#include <core/rcu.h>
+#include <core/sched.h>
 #include <core/syscall.h>
+#include <core/timer.h>
 #include <core/trap.h>
+#include <core/uring.h>
 #include <driver/clock.h>
 #include <driver/interrupt.h>
 #include <driver/irq.h>
@@ -14,37 +20,29 @@ void init_trap() {
     arch_reset_esr();
 }
 
-void trap_global_handler(Trapframe *frame) {
-    u64 esr = arch_get_esr();
-    // printf("esr : %u\n", esr);
+/*
+ * Synchronous exceptions from EL0 other than system calls, which are
+ * dispatched directly by `sync_entry` in `trap.S`. IRQs go to
+ * `interrupt_global_handler`.
+ */
+void trap_global_handler(Trapframe *frame, u64 esr) {
     u64 ec = esr >> ESR_EC_SHIFT;
-    u64 iss = esr & ESR_ISS_MASK;
-    u64 ir = esr & ESR_IR_MASK;
-
-    // u32 src = get32(IRQ_SRC_CORE(cpuid()));
-    arch_reset_esr();
 
     switch (ec) {
-        case ESR_EC_UNKNOWN: {
-            if (ir)
-                PANIC("esr_ec unknown error");
-            else
-                interrupt_global_handler();
+        case ESR_EC_FP: {
+            fpsimd_trap();
         } break;
-        case ESR_EC_SVC64: {
-            /*
-			 * Here, it is a syscall request.
-			 * Call `syscall_dispatch` and
-			 * record the return value.
-			 * Note: this function returns void,
-			 * where to record the return value?
-			 */
-			/* : Lab3 Syscall */
-            syscall_dispatch(frame);
-            // : warn if `iss` is not zero.
-            if(iss)
-                PANIC("iss should not be zero");
-            
+
+        case ESR_EC_IABORT:
+        case ESR_EC_DABORT: {
+            u64 addr = arch_get_far();
+            if (!handle_page_fault(thiscpu()->proc, addr, esr)) {
+                printf("(error) pid %d: bad access to %p at pc %p\n",
+                       thiscpu()->proc->pid,
+                       (void *)addr,
+                       (void *)frame->ELR_EL1);
+                exit();
+            }
         } break;
 
         default: {
@@ -52,11 +50,17 @@ void trap_global_handler(Trapframe *frame) {
             exit();
         }
     }
-    /*
-	 * Hint: For testing, you can set frame->x6 to 0xdead here.
-	 * Use GDB to check whether x6 is correct after `trap_return` finishes.
-	 * If another register changes to 0xdead, fix the bug in trapframe design.
-	 */
+}
+
+/*
+ * Called by `interrupt_entry` after the interrupt has been handled, right
+ * before returning to user space.
+ */
+void interrupt_return() {
+    timer_poll();
+    rcu_poll();
+    uring_poll();
+    preempt_if_needed();
 }
 
 NORETURN void trap_error_handler(u64 type) {
@@ -7,10 +7,12 @@
 #define ESR_IR_MASK  (1 << 25)
 
 #define ESR_EC_UNKNOWN 0x00
+#define ESR_EC_FP      0x07
 #define ESR_EC_SVC64   0x15
 #define ESR_EC_IABORT  0x20
 #define ESR_EC_DABORT  0x24
 
 void init_trap();
-void trap_global_handler(Trapframe *frame);
+void trap_global_handler(Trapframe *frame, u64 esr);
+void interrupt_return();
 NO_RETURN void trap_error_handler(u64 type);
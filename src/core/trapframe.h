@@ -10,6 +10,8 @@
  * elr_el1, spsr_el1 and  sp_el0.
  * Pay attention to the order of these registers
  * in your trapframe.
+ * On the syscall fast path, x19~x29 stay in registers
+ * and their slots are not filled (see `trap.S`).
  */
 typedef struct {
 	/* : Lab3 Interrupt */
@@ -0,0 +1,81 @@
+#include <aarch64/intrinsic.h>
+#include <aarch64/mmu.h>
+#include <common/string.h>
+#include <core/console.h>
+#include <core/physical_memory.h>
+#include <core/proc.h>
+#include <core/sched.h>
+#include <core/syscall.h>
+#include <core/uring.h>
+#include <core/virtual_memory.h>
+
+_Static_assert(offset_of(UringPage, sq_head) == URING_SQ_HEAD, "wrong URING_SQ_HEAD");
+_Static_assert(offset_of(UringPage, sq_tail) == URING_SQ_TAIL, "wrong URING_SQ_TAIL");
+_Static_assert(offset_of(UringPage, cq_head) == URING_CQ_HEAD, "wrong URING_CQ_HEAD");
+_Static_assert(offset_of(UringPage, cq_tail) == URING_CQ_TAIL, "wrong URING_CQ_TAIL");
+_Static_assert(offset_of(UringPage, sq) == URING_SQ_ENTRIES, "wrong URING_SQ_ENTRIES");
+_Static_assert(offset_of(UringPage, cq) == URING_CQ_ENTRIES, "wrong URING_CQ_ENTRIES");
+_Static_assert(sizeof(UringSqe) == URING_SQE_SIZE, "wrong URING_SQE_SIZE");
+_Static_assert(offset_of(UringSqe, user_data) == URING_SQE_USER_DATA,
+               "wrong URING_SQE_USER_DATA");
+_Static_assert(sizeof(UringCqe) == URING_CQE_SIZE, "wrong URING_CQE_SIZE");
+_Static_assert(sizeof(UringPage) <= PAGE_SIZE, "UringPage does not fit in a page");
+
+u64 uring_setup(struct proc *p) {
+    if (p->uring)
+        return URING_BASE;
+
+    UringPage *page = kalloc_zeroed();
+    if (uvm_map(p->pgdir, (void *)URING_BASE, PAGE_SIZE, K2P(page)) < 0)
+        PANIC("uring_setup: failed to map the ring page");
+    p->uring = page;
+
+    arch_fence();
+    return URING_BASE;
+}
+
+usize uring_drain(struct proc *p) {
+    UringPage *page = p->uring;
+    if (!page)
+        return 0;
+
+    usize num_completed = 0;
+    u32 sq_head = page->sq_head;
+    u32 sq_tail = __atomic_load_n(&page->sq_tail, __ATOMIC_ACQUIRE);
+    u32 cq_tail = page->cq_tail;
+
+    // the process may scribble anything over the shared page: never trust
+    // more than a full ring of submissions.
+    if (sq_tail - sq_head > URING_SQ_SIZE)
+        sq_head = sq_tail - URING_SQ_SIZE;
+
+    while (sq_head != sq_tail) {
+        u32 cq_head = __atomic_load_n(&page->cq_head, __ATOMIC_ACQUIRE);
+        if (cq_tail - cq_head >= URING_CQ_SIZE)
+            break;
+
+        UringSqe sqe = page->sq[sq_head & (URING_SQ_SIZE - 1)];
+        sq_head++;
+        __atomic_store_n(&page->sq_head, sq_head, __ATOMIC_RELEASE);
+
+        // a ring call from inside a ring would recurse forever.
+        u64 result = (u64)-1;
+        if (sqe.sysnum != SYS_myring_setup && sqe.sysnum != SYS_myring_enter)
+            result = syscall_invoke(sqe.sysnum, sqe.args);
+
+        UringCqe *cqe = &page->cq[cq_tail & (URING_CQ_SIZE - 1)];
+        cqe->user_data = sqe.user_data;
+        cqe->result = result;
+        cq_tail++;
+        __atomic_store_n(&page->cq_tail, cq_tail, __ATOMIC_RELEASE);
+        num_completed++;
+    }
+
+    return num_completed;
+}
+
+void uring_poll() {
+    struct proc *p = thiscpu()->proc;
+    if (p && p->uring)
+        uring_drain(p);
+}
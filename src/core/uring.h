@@ -0,0 +1,82 @@
+#pragma once
+
+// per-process submission/completion rings for batched system calls.
+//
+// a process asks for its rings once with `SYS_myring_setup`, which maps one
+// shared page at `URING_BASE`. It then queues system calls into the
+// submission ring and publishes them by advancing `sq_tail`. The kernel
+// drains the ring in batches, either when the process calls
+// `SYS_myring_enter` or on the next interrupt taken from the process, and
+// posts one completion per submission to the completion ring.
+//
+// heads are advanced by the consumer and tails by the producer. Producers
+// fill entries before a release store to the tail; consumers load the tail
+// with acquire semantics before reading entries.
+// this header is also included by user programs in `src/user`.
+
+// the page sits right below the vdso page.
+#define URING_BASE 0xffffffffe000
+
+// number of entries of each ring. Must be powers of two.
+#define URING_SQ_SIZE 32
+#define URING_CQ_SIZE 64
+
+// offsets of the fields of `UringPage`, for assembly.
+#define URING_SQ_HEAD    0
+#define URING_SQ_TAIL    4
+#define URING_CQ_HEAD    8
+#define URING_CQ_TAIL    12
+#define URING_SQ_ENTRIES 64
+#define URING_CQ_ENTRIES (URING_SQ_ENTRIES + URING_SQ_SIZE * URING_SQE_SIZE)
+
+// layout of `UringSqe`.
+#define URING_SQE_SYSNUM    0
+#define URING_SQE_ARGS      8
+#define URING_SQE_USER_DATA 56
+#define URING_SQE_SIZE      64
+
+// layout of `UringCqe`.
+#define URING_CQE_USER_DATA 0
+#define URING_CQE_RESULT    8
+#define URING_CQE_SIZE      16
+
+#ifndef __ASSEMBLER__
+
+#include <common/defines.h>
+
+struct proc;
+
+typedef struct UringSqe {
+    u64 sysnum;
+    u64 args[6];
+    u64 user_data;  // copied to the completion untouched.
+} UringSqe;
+
+typedef struct UringCqe {
+    u64 user_data;
+    u64 result;  // what the system call returned in x0.
+} UringCqe;
+
+typedef struct UringPage {
+    u32 sq_head;
+    u32 sq_tail;
+    u32 cq_head;
+    u32 cq_tail;
+    u8 _reserved[URING_SQ_ENTRIES - 16];
+    UringSqe sq[URING_SQ_SIZE];
+    UringCqe cq[URING_CQ_SIZE];
+} UringPage;
+
+// allocate and map the rings of the current process `p`. Return the user
+// address of the shared page.
+u64 uring_setup(struct proc *p);
+
+// run the queued submissions of `p` while the completion ring has room.
+// Return the number of completions posted.
+usize uring_drain(struct proc *p);
+
+// drain the rings of the current process, if it has any. Called by
+// `interrupt_return` before returning to user space.
+void uring_poll();
+
+#endif
@@ -0,0 +1,32 @@
+#include <aarch64/mmu.h>
+#include <common/string.h>
+#include <core/console.h>
+#include <core/container.h>
+#include <core/physical_memory.h>
+#include <core/proc.h>
+#include <core/sched.h>
+#include <core/vdso.h>
+#include <core/virtual_memory.h>
+
+_Static_assert(offset_of(VdsoData, counter_frequency) == VDSO_COUNTER_FREQUENCY,
+               "wrong VDSO_COUNTER_FREQUENCY");
+_Static_assert(offset_of(VdsoData, pid) == VDSO_PID, "wrong VDSO_PID");
+_Static_assert(offset_of(VdsoData, root_pid) == VDSO_ROOT_PID, "wrong VDSO_ROOT_PID");
+_Static_assert(offset_of(VdsoData, container_id) == VDSO_CONTAINER_ID,
+               "wrong VDSO_CONTAINER_ID");
+
+void vdso_setup(struct proc *p) {
+    assert(p->vdso == NULL);
+
+    VdsoData *data = kalloc_zeroed();
+    data->counter_frequency = get_clock_frequency();
+    data->pid = p->pid;
+    data->root_pid = root_pid(p);
+    data->container_id = container_id(thiscpu()->scheduler->cont);
+
+    if (uvm_map_readonly(p->pgdir, (void *)VDSO_BASE, PAGE_SIZE, K2P(data)) < 0)
+        PANIC("vdso_setup: failed to map the vdso page");
+    p->vdso = data;
+
+    uvm_publish();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// a read-only page the kernel maps into every user address space, so that
+// user programs can learn about themselves without trapping.
+// this header is also included by user programs in `src/user`.
+
+// the page sits right below the top of the user address space.
+#define VDSO_BASE 0xfffffffff000
+
+// offsets of the fields of `VdsoData`, for assembly.
+#define VDSO_COUNTER_FREQUENCY 0
+#define VDSO_PID               8
+#define VDSO_ROOT_PID          12
+#define VDSO_CONTAINER_ID      16
+
+#ifndef __ASSEMBLER__
+
+#include <common/defines.h>
+
+struct proc;
+
+typedef struct VdsoData {
+    u64 counter_frequency;  // ticks per second of `cntvct_el0`.
+    i32 pid;                // pid inside the process's container.
+    i32 root_pid;           // pid as seen by the root container.
+    i32 container_id;       // pid of the container's scheduler, zero for the root.
+} VdsoData;
+
+// allocate, fill and map the page of the current process `p`.
+void vdso_setup(struct proc *p);
+
+#endif
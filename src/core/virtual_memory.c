@@ -28,8 +28,18 @@ int uvm_map(PTEntriesPtr pgdir, void *va, size_t sz, uint64_t pa) {
 }
 
 void uvm_switch(PTEntriesPtr pgdir) {
+    extern PTEntries kernel_pt;
     // FIXME: Use NG and ASID for efficiency.
-    arch_set_ttbr0(K2P(pgdir));
+    // without an address space, fall back to the boot identity map.
+    arch_set_ttbr0(K2P(pgdir ? pgdir : kernel_pt));
+}
+
+/*
+ * Make entries just added to a live page table visible to the table walker
+ * before the new mapping is used.
+ */
+void uvm_publish() {
+    arch_fence();
 }
 
 /*
@@ -39,38 +49,104 @@ void uvm_switch(PTEntriesPtr pgdir) {
 static PTEntriesPtr 
 my_pgdir_init() {
     /* : Lab2 memory*/
-    PTEntriesPtr pgdir = kalloc();
-    memset(pgdir, 0, PAGE_SIZE);
-    return pgdir;
+    return kalloc_zeroed();
+}
+
+/* Size of the region mapped by one entry of a level `index` table. */
+#define SPAN(index) (1ull << (12 + 9 * (index)))
+
+/* Entries of a contiguous run, which the TLB may cache as one. */
+#define CONT_ENTRIES 16
+
+static bool is_block(PTEntry pte, int index) {
+    return index > 0 && (pte & PTE_TABLE) == PTE_BLOCK;
+}
+
+/*
+ * Clear the contiguous hint of the run containing `pte`, before one of its
+ * entries changes on its own.
+ */
+static void break_contiguous(PTEntriesPtr pte) {
+    PTEntriesPtr run = (PTEntriesPtr)ROUNDDOWN((uint64_t)pte, CONT_ENTRIES * sizeof(PTEntry));
+    for (int i = 0; i < CONT_ENTRIES; i++)
+        run[i] &= ~PTE_CONT;
+    arch_tlbi_vmalle1is();
+}
+
+/*
+ * Replace the block entry `*pte` of a level `index` table by a table that
+ * maps the same memory with the next level of entries.
+ */
+static PTEntriesPtr split_block(PTEntriesPtr pte, int index) {
+    PTEntriesPtr table = kalloc();
+    if (table == NULL)
+        return NULL;
+    if (*pte & PTE_CONT)
+        break_contiguous(pte);
+
+    uint64_t flags = *pte & ~PTE_ADDRESS(*pte);
+    uint64_t type = index - 1 > 0 ? PTE_BLOCK : PTE_PAGE;
+    for (uint64_t i = 0; i < N_PTE_PER_TABLE; i++)
+        table[i] = (PTE_ADDRESS(*pte) + i * SPAN(index - 1)) | (flags & ~(uint64_t)PTE_TABLE) | type;
+
+    // break before make: the block must leave the TLB first.
+    *pte = 0;
+    arch_tlbi_vmalle1is();
+    *pte = K2P(table) | PTE_TABLE;
+    arch_fence();
+    return table;
+}
+
+/*
+ * return the table that the level `index` entry `*p` points to. A block
+ * is split into a table. if alloc != 0, create a missing table.
+ */
+
+static PTEntriesPtr
+_next_table(PTEntriesPtr p, int index, int alloc) {
+    PTEntriesPtr table;
+    if (is_block(*p, index))
+        return split_block(p, index);
+    if (*p & PTE_VALID)
+        return (PTEntriesPtr)P2K(PTE_ADDRESS(*p));
+    if (!alloc || !(table = kalloc_zeroed()))
+        return 0;
+    *p = K2P((int64_t)table) | PTE_TABLE;
+    return table;
+}
+
+/*
+ * return the address of the level `index` entry in user page table
+ * pgdir that corresponds to virtual address va.
+ * if alloc != 0, create any required page table pages.
+ */
+
+static PTEntriesPtr
+_walk(PTEntriesPtr pgdir, uint64_t va, int index, int alloc) {
+    for (int i = 3; i > index; i--) {
+        if (!(pgdir = _next_table(&pgdir[PTX(i, va)], i, alloc)))
+            return 0;
+    }
+    return &pgdir[PTX(index, va)];
 }
 
 /*
  * return the address of the pte in user page table
  * pgdir that corresponds to virtual address va.
  * if alloc != 0, create any required page table pages.
+ * even if alloc == 0, a block on the way is split into a table of pages,
+ * so the walk may allocate a table page and change the entries above it.
  */
 
 static PTEntriesPtr 
 my_pgdir_walk(PTEntriesPtr pgdir, void *vak, int alloc) {
     /* : Lab2 memory*/
-    int index = 3;
-    for(; index > 0; index--) {
-        PTEntriesPtr p = &pgdir[PTX(index, (int64_t)vak)];
-        if (*p & PTE_VALID) {
-            // pte should table rather than block.
-            pgdir = (PTEntriesPtr)P2K(PTE_ADDRESS(*p));
-        } else{
-            if (!alloc || !(pgdir = kalloc())) 
-                return 0;
-            *p = K2P((int64_t)pgdir) | PTE_TABLE; 
-        }
-    }
-    return &pgdir[PTX(0, (int64_t)vak)];
+    return _walk(pgdir, (uint64_t)vak, 0, alloc);
 }
 
 /* A helper function for my_vm_free */
 static void 
-my_vm_free_helper(PTEntriesPtr pgdir, int64_t index) {
+my_vm_free_helper(PTEntriesPtr pgdir, int index) {
     int x = 0;
     PTEntriesPtr p, q;
     for(; x < 512; x++) {
@@ -78,45 +154,165 @@ my_vm_free_helper(PTEntriesPtr pgdir, int64_t index) {
         if (*p & PTE_VALID) {
             q = (PTEntriesPtr)P2K(PTE_ADDRESS(*p));  
             if (index == 0) {
-                *p = NULL;
+                *p = 0;
                 kfree(q);
             }
-            else
+            else if (is_block(*p, index)) {
+                *p = 0;
+                for (uint64_t off = 0; off < SPAN(index); off += PAGE_SIZE)
+                    kfree((char *)q + off);
+            }
+            else {
                 my_vm_free_helper(q, index-1);
+                *p = 0;
+                kfree(q);
+            }
         }
     }
 }
 
-/* Free a user page table and all the physical memory pages. */
+/*
+ * Free a user page table, its table pages and all the physical memory pages.
+ * `pgdir` must not be live in TTBR0 of any CPU.
+ */
 
 void 
 my_vm_free(PTEntriesPtr pgdir) {
     /* : Lab2 memory*/
     my_vm_free_helper(pgdir, 3);
+    kfree(pgdir);
+}
+
+/*
+ * Fill the entries of the level `index` table `table` for [va, end), which
+ * map to pa onwards. The whole request is [start, end).
+ * Level 1 entries become 2MB blocks when va and pa are aligned and the rest
+ * of the request covers the block. Runs of CONT_ENTRIES pages get the
+ * contiguous hint when the request covers them and pa is aligned alike.
+ */
+
+static int
+_map_range(PTEntriesPtr table, int index, uint64_t va, uint64_t end, uint64_t pa,
+           uint64_t flags, uint64_t start) {
+    uint64_t span = SPAN(index), run = CONT_ENTRIES * span;
+    for (int i = PTX(index, va); i < N_PTE_PER_TABLE && va < end; i++) {
+        uint64_t next = MIN(ROUNDDOWN(va, span) + span, end);
+        PTEntriesPtr p = &table[i];
+        bool leaf = index == 0 ||
+            (index == 1 && va % span == 0 && pa % span == 0 && next - va == span &&
+             !(*p & PTE_VALID && !is_block(*p, index)));
+
+        if (!leaf) {
+            PTEntriesPtr next_table = _next_table(p, index, 1);
+            if (next_table == NULL)
+                return -1;
+            if (_map_range(next_table, index - 1, va, next, pa, flags, start) < 0)
+                return -1;
+        } else {
+            if (*p & PTE_CONT)
+                break_contiguous(p);
+            uint64_t entry = PTE_ADDRESS(pa) | (index > 0 ? (flags & ~(uint64_t)PTE_TABLE) | PTE_BLOCK : flags);
+            uint64_t first = ROUNDDOWN(va, run);
+            if (index == 0 && first >= start && first + run <= end && (va - pa) % run == 0)
+                entry |= PTE_CONT;
+            *p = entry;
+        }
+        pa += next - va;
+        va = next;
+    }
+    return 0;
 }
 
 /*
  * Create PTEs for virtual addresses starting at va that refer to
  * physical addresses starting at pa. va and size might not
- * be page-aligned.
+ * be page-aligned. Every PTE gets `flags`.
+ * The tables are walked once for the whole range, not once per page.
  * Return -1 if failed else 0.
  */
 
+static int
+_uvm_map_flags(PTEntriesPtr pgdir, void *va, size_t sz, uint64_t pa, uint64_t flags) {
+    uint64_t start = ROUNDDOWN((uint64_t)va, PAGE_SIZE),
+             end = ROUNDUP((uint64_t)va + sz, PAGE_SIZE);
+    return _map_range(pgdir, 3, start, end, ROUNDDOWN(pa, PAGE_SIZE), flags, start);
+}
+
 int my_uvm_map(PTEntriesPtr pgdir, void *va, size_t sz, uint64_t pa) {
     /* : Lab2 memory*/
-    char *start = (char *) ROUNDDOWN((uint64_t)va, PAGE_SIZE),
-         *end = (char *) ROUNDDOWN((uint64_t)va + sz - 1, PAGE_SIZE),
-         *p = start;
-    for(; p <= end; p += PAGE_SIZE) {
-        PTEntriesPtr pte = my_pgdir_walk(pgdir, va, 1);
+    return _uvm_map_flags(pgdir, va, sz, pa, PTE_USER_DATA);
+}
+
+/* Same as uvm_map, but user programs can only read the pages. */
+
+int uvm_map_readonly(PTEntriesPtr pgdir, void *va, size_t sz, uint64_t pa) {
+    return _uvm_map_flags(pgdir, va, sz, pa, PTE_USER_RO_DATA);
+}
+
+/*
+ * Remove the mappings of [va, va + sz) and drop their references to the
+ * pages. va and size might not be page-aligned.
+ */
+
+void uvm_unmap(PTEntriesPtr pgdir, void *va, size_t sz) {
+    uint64_t start = ROUNDDOWN((uint64_t)va, PAGE_SIZE),
+             end = ROUNDUP((uint64_t)va + sz, PAGE_SIZE);
+    for (uint64_t p = start; p < end; p += PAGE_SIZE) {
+        PTEntriesPtr pte = _walk(pgdir, p, 0, 0);
+        if (pte == NULL || !(*pte & PTE_VALID))
+            continue;
+        if (*pte & PTE_CONT)
+            break_contiguous(pte);
+        kfree((void *)P2K(PTE_ADDRESS(*pte)));
+        *pte = 0;
+    }
+    arch_tlbi_vmalle1is();
+}
+
+/*
+ * Share the user pages of `src` within [start, end) with `dst` for
+ * copy-on-write. `level` and `base` describe the table `src` points to.
+ * Writable pages become read-only in both page tables and are copied on
+ * the first write fault (see `page_fault.c`). Blocks are shared whole and
+ * split by the first fault.
+ */
+
+static int
+_uvm_share(PTEntriesPtr dst, PTEntriesPtr src, int level, uint64_t base, uint64_t start, uint64_t end) {
+    uint64_t span = SPAN(level);
+    for (uint64_t i = 0; i < N_PTE_PER_TABLE; i++) {
+        uint64_t va = base + i * span;
+        if (!(src[i] & PTE_VALID) || va + span <= start || va >= end)
+            continue;
+        if (level > 0 && !is_block(src[i], level)) {
+            PTEntriesPtr table = (PTEntriesPtr)P2K(PTE_ADDRESS(src[i]));
+            if (_uvm_share(dst, table, level - 1, va, start, end) < 0)
+                return -1;
+            continue;
+        }
+
+        // pages are copied one by one, so runs are not contiguous anymore.
+        if (src[i] & PTE_CONT)
+            break_contiguous(&src[i]);
+        if (!(src[i] & PTE_RO))
+            src[i] |= PTE_RO | PTE_COW;
+        PTEntriesPtr pte = _walk(dst, va, level, 1);
         if (pte == NULL) 
             return -1;
-        *pte =  PTE_ADDRESS(pa) | PTE_USER_DATA;
-        pa += PAGE_SIZE;
+        for (uint64_t off = 0; off < span; off += PAGE_SIZE)
+            kref((void *)P2K(PTE_ADDRESS(src[i]) + off));
+        *pte = src[i];
     }
     return 0;
 }
 
+int uvm_share(PTEntriesPtr dst, PTEntriesPtr src, uint64_t start, uint64_t end) {
+    int r = _uvm_share(dst, src, 3, 0, start, end);
+    // `src` may be live: drop the writable entries cached by the TLB.
+    arch_tlbi_vmalle1is();
+    return r;
+}
+
 void virtual_memory_init(VMemory *vmem_ptr) {
     vmem_ptr->pgdir_init = my_pgdir_init;
     vmem_ptr->pgdir_walk = my_pgdir_walk;
@@ -176,21 +372,50 @@ void test1_pm_kfree_kalloc() {
 void test2_vm_map_walk() {
     // basic test of virtual memory API.
     PTEntriesPtr pgdir = my_pgdir_init();
+    void *page = kalloc();
     PTEntriesPtr v[] = {(PTEntriesPtr)P2K(0x12000)};
-    PTEntriesPtr p[] = {0x12000};
-    my_uvm_map(pgdir, v[0], 1, (int64_t)p[0]);
+    my_uvm_map(pgdir, v[0], 1, K2P(page));
     uint64_t a = PTE_ADDRESS(*my_pgdir_walk(pgdir, v[0], 1));
-    assert((uint64_t)p[0] == a);
+    assert(K2P(page) == a);
+    // the table is gone after the free, but the page it held is released.
+    kref(page);
     my_vm_free(pgdir);
-    uint64_t b = PTE_ADDRESS(*my_pgdir_walk(pgdir, v[0], 1));
-    assert(b == NULL);
+    assert(kref_count(page) == 1);
+    kfree(page);
     printf("test2_vm pass.\n");
 }
 
+void test3_vm_block_map() {
+    // a 2MB-aligned region is mapped by one block, the tail by pages.
+    uint64_t size = 0x210000, num_pages = (size + SPAN(1)) / PAGE_SIZE;
+    char *run = nkalloc((int)num_pages);
+    char *first = (char *)ROUNDUP((uint64_t)run, SPAN(1));
+    // keep only the pages to be mapped, which `my_vm_free` frees.
+    for (char *page = run; page < run + num_pages * PAGE_SIZE; page += PAGE_SIZE) {
+        if (page < first || page >= first + size)
+            kfree(page);
+    }
+
+    PTEntriesPtr pgdir = my_pgdir_init();
+    uint64_t va = 0x40000000, pa = K2P(first);
+    my_uvm_map(pgdir, (void *)va, size, pa);
+    PTEntriesPtr block = _walk(pgdir, va, 1, 0);
+    assert(is_block(*block, 1) && PTE_ADDRESS(*block) == pa);
+    PTEntriesPtr pte = _walk(pgdir, va + 0x200000, 0, 0);
+    assert(PTE_ADDRESS(*pte) == pa + 0x200000 && (*pte & PTE_CONT));
+    // walking into the block splits it.
+    pte = my_pgdir_walk(pgdir, (void *)(va + 0x5000), 0);
+    assert(PTE_ADDRESS(*pte) == pa + 0x5000 && !is_block(*block, 1));
+    my_vm_free(pgdir);
+    assert(kref_count(first) == 0 && kref_count(first + size - PAGE_SIZE) == 0);
+    printf("test3_vm pass.\n");
+}
+
 void vm_test() {
     /* : Lab2 memory*/
     test0_yifan_test();
     test1_pm_kfree_kalloc();
     test2_vm_map_walk();
+    test3_vm_block_map();
     // Certify that your code works!
 }
@@ -8,6 +8,20 @@
 #define USERTOP  0x0001000000000000
 #define KERNBASE 0xFFFF000000000000
 
+/*
+ * User stacks grow down from USER_STACK_TOP. Pages are allocated on the first
+ * fault, up to USER_STACK_SIZE bytes.
+ */
+#define USER_STACK_TOP  0x0000FFFF00000000
+#define USER_STACK_SIZE 0x100000
+
+/*
+ * Files are mapped from USER_MMAP_BASE on, one slot of USER_MMAP_SLOT_SIZE
+ * bytes per mapping. The heap stays below.
+ */
+#define USER_MMAP_BASE      0x0000800000000000
+#define USER_MMAP_SLOT_SIZE 0x40000000
+
 /*
  * uvm stands user vitual memory.
  */
@@ -26,7 +40,14 @@ PTEntriesPtr pgdir_init(void);
 PTEntriesPtr pgdir_walk(PTEntriesPtr pgdir, void *kernel_address, int alloc);
 void vm_free(PTEntriesPtr pgdir);
 int uvm_map(PTEntriesPtr pgdir, void *kernel_address, size_t size, uint64_t physical_address);
+int uvm_map_readonly(PTEntriesPtr pgdir,
+                     void *kernel_address,
+                     size_t size,
+                     uint64_t physical_address);
+void uvm_unmap(PTEntriesPtr pgdir, void *kernel_address, size_t size);
+int uvm_share(PTEntriesPtr dst, PTEntriesPtr src, uint64_t start, uint64_t end);
 void uvm_switch(PTEntriesPtr pgdir);
+void uvm_publish();
 void virtual_memory_init(VMemory *);
 void init_virtual_memory();
 void vm_test();
@@ -0,0 +1,134 @@
+#include <common/spinlock.h>
+#include <core/console.h>
+#include <core/percpu.h>
+#include <core/proc.h>
+#include <core/sched.h>
+#include <core/workqueue.h>
+
+typedef struct {
+    SpinLock lock;
+    ListNode pending;  // queued `Work`s, oldest first.
+    struct proc *worker;
+    u64 num_done;  // number of works run.
+} WorkQueue;
+
+static DEFINE_PER_CPU(WorkQueue, workqueue);
+
+void init_work(Work *work, WorkFunc func, u64 data) {
+    init_list_node(&work->node);
+    work->func = func;
+    work->data = data;
+    work->pending = false;
+}
+
+void init_workqueue() {
+    WorkQueue *wq = this_cpu_ptr(&workqueue);
+    init_spinlock(&wq->lock, "workqueue");
+    init_list_node(&wq->pending);
+    wq->worker = NULL;
+    wq->num_done = 0;
+}
+
+// body of the worker of `cpu`. It sleeps on its queue while there is
+// nothing to do.
+static void _worker(u64 cpu) {
+    WorkQueue *wq = this_cpu_ptr(&workqueue);
+    assert(cpuid() == cpu);
+
+    acquire_spinlock(&wq->lock);
+    while (true) {
+        if (wq->pending.next == &wq->pending) {
+            sleep(wq, &wq->lock);
+            continue;
+        }
+
+        Work *work = container_of(wq->pending.next, Work, node);
+        detach_from_list(&work->node);
+        // from now on `work` may be queued again, or freed by its owner
+        // once `func` has returned.
+        __atomic_store_n(&work->pending, false, __ATOMIC_RELEASE);
+        wq->num_done++;
+        release_spinlock(&wq->lock);
+
+        work->func(work);
+        acquire_spinlock(&wq->lock);
+    }
+}
+
+void spawn_workers() {
+    for (usize i = 0; i < NCPU; i++) {
+        per_cpu_ptr(&workqueue, i)->worker = create_kthread("kworker", _worker, i, (isize)i);
+    }
+}
+
+bool queue_work_on(usize cpu, Work *work) {
+    if (__atomic_exchange_n(&work->pending, true, __ATOMIC_ACQ_REL))
+        return false;
+
+    WorkQueue *wq = per_cpu_ptr(&workqueue, cpu);
+    acquire_spinlock(&wq->lock);
+    merge_list(wq->pending.prev, &work->node);
+    release_spinlock(&wq->lock);
+    wakeup(wq);
+    return true;
+}
+
+bool queue_work(Work *work) {
+    return queue_work_on(cpuid(), work);
+}
+
+// the last work queued by `flush_workqueue`.
+static void _barrier(Work *work) {
+    WorkQueue *wq = this_cpu_ptr(&workqueue);
+    acquire_spinlock(&wq->lock);
+    work->data = true;
+    wakeup(work);
+    release_spinlock(&wq->lock);
+}
+
+void flush_workqueue(usize cpu) {
+    WorkQueue *wq = per_cpu_ptr(&workqueue, cpu);
+    assert(thiscpu()->proc != wq->worker);
+
+    // works run in order, so everything queued before `barrier` has run
+    // once it has.
+    Work barrier;
+    init_work(&barrier, _barrier, false);
+    queue_work_on(cpu, &barrier);
+
+    acquire_spinlock(&wq->lock);
+    while (!barrier.data) {
+        sleep(&barrier, &wq->lock);
+    }
+    release_spinlock(&wq->lock);
+}
+
+static void _test_work(Work *work) {
+    __atomic_fetch_add((u64 *)work->data, 1, __ATOMIC_RELAXED);
+}
+
+// queue works on all CPUs, some of them twice, and wait for them.
+// Must be called from a process.
+void workqueue_test() {
+    enum { NUM_WORKS = 64 };
+    static Work works[NUM_WORKS];
+    u64 count = 0;
+
+    usize num_queued = 0;
+    for (usize i = 0; i < NUM_WORKS; i++) {
+        init_work(&works[i], _test_work, (u64)&count);
+        if (queue_work_on(i % NCPU, &works[i]))
+            num_queued++;
+        if (i % 2 == 0 && queue_work_on((i + 1) % NCPU, &works[i]))
+            num_queued++;
+    }
+    for (usize i = 0; i < NCPU; i++) {
+        flush_workqueue(i);
+    }
+
+    assert(count == num_queued);
+    for (usize i = 0; i < NUM_WORKS; i++) {
+        assert(!works[i].pending);
+    }
+    printf("workqueue_test PASS: %llu works\n", count);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <common/defines.h>
+#include <common/list.h>
+
+// per-CPU workqueues.
+//
+// every CPU runs a kernel thread, "kworker", that executes the `Work`s
+// queued on that CPU one by one. Unlike interrupt handlers and timer
+// callbacks, a work function runs in process context: it may sleep, take
+// mutexes and wait for I/O. Slow parts of latency-critical paths can thus
+// be queued and finished later.
+//
+// a `Work` is pending on at most one CPU at a time. Queueing it again
+// before it starts running does nothing, so repeated requests for the same
+// job coalesce into one run. A work function may queue its own `Work`.
+//
+// > static Work flush_work;
+// > init_work(&flush_work, flush_something, 0);
+// > queue_work(&flush_work);
+
+struct Work;
+
+typedef void (*WorkFunc)(struct Work *work);
+
+typedef struct Work {
+    ListNode node;
+    WorkFunc func;
+    u64 data;  // free for the owner of the work.
+    bool pending;
+} Work;
+
+void init_work(Work *work, WorkFunc func, u64 data);
+
+// set up the workqueue of the current CPU.
+void init_workqueue();
+
+// create the worker threads of all CPUs. Each one is bound to its CPU.
+void spawn_workers();
+
+// queue `work` on the current CPU or on `cpu`. Return false if it was
+// already pending. Callable from interrupt handlers.
+bool queue_work(Work *work);
+bool queue_work_on(usize cpu, Work *work);
+
+// wait until everything queued on `cpu` so far has run. Must be called
+// from a process other than the worker of `cpu`.
+void flush_workqueue(usize cpu);
+
+void workqueue_test();
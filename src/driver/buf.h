@@ -13,8 +13,11 @@
 typedef struct buf {
     int flags;
     u32 blockno;
+    u32 nblocks;  // blocks moved by the request, starting at `blockno`.
+    u8 **blocks;  // where each of them is, or NULL for the single `data`.
     ListNode listnode;
-    u8 data[BSIZE];  // 1B*512
+    // filled by DMA, so it must not share cache lines with other fields.
+    u8 data[BSIZE] __attribute__((aligned(CACHE_LINE_SIZE)));  // 1B*512
 } buf;
 
 static SpinLock buflock; // Do not forget to initialize it.
@@ -1,5 +1,6 @@
 #include <aarch64/intrinsic.h>
 #include <core/console.h>
+#include <core/percpu.h>
 #include <driver/base.h>
 #include <driver/clock.h>
 
@@ -9,31 +10,92 @@
 typedef struct {
     u64 one_ms;
     ClockHandler handler;
+    ClockHandler event_handler;
+    ClockSampler sampler;
+    u64 sample_interval;  // in counter ticks.
 } ClockContext;
 
 static ClockContext ctx;
 
+// when the handler should run next on this CPU, in counter ticks.
+static DEFINE_PER_CPU(u64, handler_deadline);
+
+// when the next timer event is due on this CPU, in counter ticks.
+static DEFINE_PER_CPU(u64, event_deadline);
+
+// fire at the handler or event deadline, or earlier if the next sample is due.
+static void program_clock() {
+    u64 deadline = MIN(*this_cpu_ptr(&handler_deadline), *this_cpu_ptr(&event_deadline));
+    if (ctx.sampler)
+        deadline = MIN(deadline, get_timestamp() + ctx.sample_interval);
+    asm volatile("msr cntp_cval_el0, %[x]" ::[x] "r"(deadline));
+}
+
 void init_clock() {
     ctx.one_ms = get_clock_frequency() / 1000;
 
+    // allow user programs to read the virtual counter.
+    asm volatile("msr cntkctl_el1, %[x]" ::[x] "r"(1ll << 1));
+
     // reserve one second for the first time.
     asm volatile("msr cntp_ctl_el0, %[x]" ::[x] "r"(1ll));
+    *this_cpu_ptr(&event_deadline) = (u64)-1;
     reset_clock(1000);
 
     device_put_u32(CORE_CLOCK_CTRL(cpuid()), CORE_CLOCK_ENABLE);
 }
 
 void reset_clock(u64 countdown_ms) {
-    asm volatile("msr cntp_tval_el0, %[x]" ::[x] "r"(countdown_ms * ctx.one_ms));
+    *this_cpu_ptr(&handler_deadline) = get_timestamp() + countdown_ms * ctx.one_ms;
+    program_clock();
 }
 
 void set_clock_handler(ClockHandler handler) {
     ctx.handler = handler;
 }
 
-void invoke_clock_handler() {
+void set_clock_event(u64 deadline) {
+    *this_cpu_ptr(&event_deadline) = deadline;
+    program_clock();
+}
+
+void set_clock_event_handler(ClockHandler handler) {
+    ctx.event_handler = handler;
+}
+
+void set_clock_sampler(ClockSampler sampler, u64 frequency) {
+    if (sampler) {
+        assert(frequency > 0);
+        ctx.sample_interval = MAX(get_clock_frequency() / frequency, 1ull);
+    }
+    ctx.sampler = sampler;
+
+    // other CPUs pick up the new rate at their next clock interrupt.
+    program_clock();
+}
+
+void invoke_clock_handler(Trapframe *frame) {
+    if (ctx.sampler)
+        ctx.sampler(frame);
+
+    // the event handler is expected to call `set_clock_event` again.
+    u64 *event = this_cpu_ptr(&event_deadline);
+    if (ctx.event_handler && get_timestamp() >= *event) {
+        *event = (u64)-1;
+        ctx.event_handler();
+    }
+
+    u64 *deadline = this_cpu_ptr(&handler_deadline);
+    if (get_timestamp() < *deadline) {
+        program_clock();
+        return;
+    }
+
     if (!ctx.handler)
         PANIC("no clock handler");
 
+    // the handler is expected to call `reset_clock` again.
+    *deadline = (u64)-1;
+    program_clock();
     ctx.handler();
 }
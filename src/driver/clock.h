@@ -1,10 +1,25 @@
 #pragma once
 
 #include <common/defines.h>
+#include <core/trapframe.h>
 
 typedef void (*ClockHandler)(void);
 
+// a sampler is called with the interrupted context on every clock interrupt.
+typedef void (*ClockSampler)(Trapframe *frame);
+
 void init_clock();
 void reset_clock(u64 countdown_ms);
 void set_clock_handler(ClockHandler handler);
-void invoke_clock_handler();
+
+// let `sampler` run `frequency` times per second on every CPU, independent
+// of the countdown of `reset_clock`. A NULL `sampler` stops sampling.
+void set_clock_sampler(ClockSampler sampler, u64 frequency);
+
+// program the next timer event of this CPU, in counter ticks. `(u64)-1`
+// means no event. `handler` runs on the clock interrupt once the event is
+// due. Used by the timer wheels in `core/timer.c`.
+void set_clock_event(u64 deadline);
+void set_clock_event_handler(ClockHandler handler);
+
+void invoke_clock_handler(Trapframe *frame);
@@ -0,0 +1,66 @@
+#include <aarch64/intrinsic.h>
+#include <aarch64/mmu.h>
+#include <core/console.h>
+#include <driver/base.h>
+#include <driver/dma.h>
+
+#define DMA_CHANNEL_BASE(ch) (MMIO_BASE + 0x7000 + 0x100 * (ch))
+#define DMA_CS(ch)           (DMA_CHANNEL_BASE(ch) + 0x00)
+#define DMA_CONBLK_AD(ch)    (DMA_CHANNEL_BASE(ch) + 0x04)
+#define DMA_DEBUG(ch)        (DMA_CHANNEL_BASE(ch) + 0x20)
+#define DMA_ENABLE           (MMIO_BASE + 0x7FF0)
+
+#define CS_ACTIVE                      (1u << 0)
+#define CS_END                         (1u << 1)
+#define CS_INT                         (1u << 2)
+#define CS_ERROR                       (1u << 8)
+#define CS_PRIORITY(x)                 ((u32)(x) << 16)
+#define CS_PANIC_PRIORITY(x)           ((u32)(x) << 20)
+#define CS_WAIT_FOR_OUTSTANDING_WRITES (1u << 28)
+#define CS_RESET                       (1u << 31)
+
+// write 1 to clear.
+#define DEBUG_ERRORS 0x7
+
+#define BUS_IO_BASE  0x7E000000u
+#define BUS_RAM_BASE 0xC0000000u
+
+u32 dma_bus_address(void *kaddr) {
+    u64 addr = (u64)kaddr;
+    if (addr >= MMIO_BASE && addr < LOCAL_BASE)
+        return (u32)(addr - MMIO_BASE) + BUS_IO_BASE;
+    return (u32)K2P(addr) | BUS_RAM_BASE;
+}
+
+void init_dma_channel(usize channel) {
+    asserts(channel < DMA_NUM_CHANNELS, "DMA channel %d is not supported", channel);
+    device_put_u32(DMA_ENABLE, device_get_u32(DMA_ENABLE) | (1u << channel));
+    device_put_u32(DMA_CS(channel), CS_RESET);
+    while (device_get_u32(DMA_CS(channel)) & CS_RESET) {}
+    device_put_u32(DMA_DEBUG(channel), DEBUG_ERRORS);
+}
+
+void dma_start(usize channel, DmaControlBlock *cbs, usize num_cbs) {
+    assert(num_cbs > 0);
+    for (usize i = 0; i < num_cbs; i++) {
+        cbs[i].nextconbk = i + 1 < num_cbs ? dma_bus_address(&cbs[i + 1]) : 0;
+    }
+    arch_clean_dcache(cbs, num_cbs * sizeof(DmaControlBlock));
+
+    device_put_u32(DMA_CS(channel), CS_END | CS_INT);
+    device_put_u32(DMA_CONBLK_AD(channel), dma_bus_address(cbs));
+    device_put_u32(DMA_CS(channel),
+                   CS_ACTIVE | CS_PRIORITY(8) | CS_PANIC_PRIORITY(15) |
+                       CS_WAIT_FOR_OUTSTANDING_WRITES);
+}
+
+void dma_wait(usize channel) {
+    u32 cs;
+    while ((cs = device_get_u32(DMA_CS(channel))) & CS_ACTIVE) {
+        if (cs & CS_ERROR)
+            break;
+    }
+    if (cs & CS_ERROR)
+        PANIC("DMA channel %d error: debug 0x%x", channel, device_get_u32(DMA_DEBUG(channel)));
+    device_put_u32(DMA_CS(channel), CS_END);
+}
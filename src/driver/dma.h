@@ -0,0 +1,56 @@
+#pragma once
+
+#include <common/defines.h>
+
+// BCM2835 DMA controller. See BCM2835 ARM Peripherals, chapter 4.
+//
+// a channel executes a chain of control blocks in memory, each moving
+// `txfr_len` bytes from `source_ad` to `dest_ad`. Addresses in control
+// blocks are VideoCore bus addresses (see `dma_bus_address`). The engine
+// does not snoop CPU caches: clean buffers it reads with
+// `arch_clean_dcache` before the transfer, and flush buffers it writes
+// with `arch_flush_dcache` both before and after.
+//
+// a peripheral with a DREQ line paces the transfer through `DMA_TI_PERMAP`
+// and `DMA_TI_SRC_DREQ` or `DMA_TI_DEST_DREQ`.
+
+// `DmaControlBlock.ti`.
+#define DMA_TI_INTEN         (1 << 0)
+#define DMA_TI_WAIT_RESP     (1 << 3)
+#define DMA_TI_DEST_INC      (1 << 4)
+#define DMA_TI_DEST_DREQ     (1 << 6)
+#define DMA_TI_SRC_INC       (1 << 8)
+#define DMA_TI_SRC_DREQ      (1 << 10)
+#define DMA_TI_PERMAP(x)     ((x) << 16)
+#define DMA_TI_NO_WIDE_BURST (1 << 26)
+
+// peripheral numbers for `DMA_TI_PERMAP`.
+#define DMA_PERMAP_EMMC 11
+
+// number of channels driven through the common register block. Channel 15
+// lives elsewhere and is not supported.
+#define DMA_NUM_CHANNELS 15
+
+typedef struct DmaControlBlock {
+    u32 ti;
+    u32 source_ad;
+    u32 dest_ad;
+    u32 txfr_len;
+    u32 stride;
+    u32 nextconbk;  // bus address of the next block, 0 at the end.
+    u32 reserved[2];
+} __attribute__((aligned(32))) DmaControlBlock;
+
+// address of kernel memory or a peripheral register as the DMA engine sees
+// it. Memory is reached through the alias that bypasses the VideoCore L2.
+u32 dma_bus_address(void *kaddr);
+
+// reset `channel` and enable it.
+void init_dma_channel(usize channel);
+
+// link `cbs[0..num_cbs)` into one chain, write it back to memory and let
+// `channel` run it. `cbs` must stay untouched until the channel is done.
+void dma_start(usize channel, DmaControlBlock *cbs, usize num_cbs);
+
+// spin until `channel` has finished its chain.
+void dma_wait(usize channel);
@@ -1,6 +1,7 @@
 #include <aarch64/arm.h>
 #include <aarch64/intrinsic.h>
 #include <core/console.h>
+#include <core/sched.h>
 #include <driver/base.h>
 #include <driver/clock.h>
 #include <driver/interrupt.h>
@@ -31,6 +32,7 @@ typedef struct {
 } InterruptContext;
 
 static InterruptContext ctx;
+static usize route;
 
 void init_interrupt() {
     for (usize i = 0; i < NUM_IRQ_TYPES; i++) {
@@ -38,7 +40,17 @@ void init_interrupt() {
     }
     put32(ENABLE_IRQS_1, AUX_INT);
     put32(ENABLE_IRQS_2, VC_ARASANSDIO_INT);
-    device_put_u32(GPU_INT_ROUTE, GPU_IRQ2CORE(0));
+    set_interrupt_route(IRQ_DEFAULT_ROUTE);
+}
+
+void set_interrupt_route(usize cpu) {
+    asserts(cpu < NCPU, "routing interrupts to CPU %d", cpu);
+    route = cpu;
+    device_put_u32(GPU_INT_ROUTE, (u32)GPU_IRQ2CORE(cpu));
+}
+
+usize interrupt_route() {
+    return route;
 }
 
 void set_interrupt_handler(InterruptType type, InterruptHandler handler) {
@@ -46,13 +58,13 @@ void set_interrupt_handler(InterruptType type, InterruptHandler handler) {
     ctx.handler[type] = handler;
 }
 
-void interrupt_global_handler() {
+void interrupt_global_handler(Trapframe *frame) {
     u32 source = device_get_u32(IRQ_SRC_CORE(cpuid()));
 
     if (source & IRQ_SRC_CNTPNSIRQ) {
         source ^= IRQ_SRC_CNTPNSIRQ;
 
-        invoke_clock_handler();
+        invoke_clock_handler(frame);
     }
 
     if (source & IRQ_SRC_GPU) {
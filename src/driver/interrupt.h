@@ -4,6 +4,7 @@
 #define _DRIVER_INTERRUPT_H_
 
 #include <common/defines.h>
+#include <core/trapframe.h>
 
 // "IRQ" is the shorthand for "interrupt".
 #define NUM_IRQ_TYPES 64
@@ -14,11 +15,23 @@ typedef enum {
     IRQ_ARASANSDIO = 62,
 } InterruptType;
 
+// core that takes GPU interrupts (SD, UART) after boot.
+#define IRQ_DEFAULT_ROUTE 0
+
 typedef void (*InterruptHandler)(void);
 
 void init_interrupt();
+
+// route all GPU interrupts to `cpu`. The BCM2836 local controller cannot
+// split them between cores, and a core only takes them while it runs in
+// EL0, so `cpu` should have a user process to run (see `sd_init_idle`).
+// Handlers should stay short and leave the rest to a kernel thread on
+// another core.
+void set_interrupt_route(usize cpu);
+usize interrupt_route();
+
 void set_interrupt_handler(InterruptType type, InterruptHandler handler);
-void interrupt_global_handler();
+void interrupt_global_handler(Trapframe *frame);
 static inline void test_kernel_interrupt() {
     // arch_enable_trap();
     while (1) {
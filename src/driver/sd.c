@@ -22,13 +22,16 @@
 
 #include <common/defines.h>
 #include <core/proc.h>
+#include <core/sched.h>
+#include <core/trace.h>
 #include <driver/buf.h>
 #include <driver/clock.h>
+#include <driver/dma.h>
 #include <driver/interrupt.h>
 #include <driver/uart.h>
 
 // Private functions.
-static void sd_start(struct buf *b, bool Transfer);
+static void sd_start(struct buf *b);
 static void sd_delayus(u32 cnt);
 static int sdInit();
 static void sdParseCID();
@@ -257,12 +260,12 @@ static EMMCCommand sdCommandTable[] = {
     {"GO_INACTIVE", 0x0F000000 | CMD_RSPNS_NO, RESP_NO, RCA_YES, 0},
     {"SET_BLOCKLEN", 0x10000000 | CMD_RSPNS_48, RESP_R1, RCA_NO, 0},
     {"READ_SINGLE", 0x11000000 | CMD_RSPNS_48 | CMD_IS_DATA | TM_DAT_DIR_CH, RESP_R1, RCA_NO, 0},
-    {"READ_MULTI", 0x12000000 | CMD_RSPNS_48 | TM_MULTI_DATA | TM_DAT_DIR_CH, RESP_R1, RCA_NO, 0},
+    {"READ_MULTI", 0x12000000 | CMD_RSPNS_48 | TM_MULTI_DATA | TM_AUTO_CMD12 | TM_DAT_DIR_CH, RESP_R1, RCA_NO, 0},
     {"SEND_TUNING", 0x13000000 | CMD_RSPNS_48, RESP_R1, RCA_NO, 0},
     {"SPEED_CLASS", 0x14000000 | CMD_RSPNS_48B, RESP_R1b, RCA_NO, 0},
     {"SET_BLOCKCNT", 0x17000000 | CMD_RSPNS_48, RESP_R1, RCA_NO, 0},
     {"WRITE_SINGLE", 0x18000000 | CMD_RSPNS_48 | CMD_IS_DATA | TM_DAT_DIR_HC, RESP_R1, RCA_NO, 0},
-    {"WRITE_MULTI", 0x19000000 | CMD_RSPNS_48 | TM_MULTI_DATA | TM_DAT_DIR_HC, RESP_R1, RCA_NO, 0},
+    {"WRITE_MULTI", 0x19000000 | CMD_RSPNS_48 | TM_MULTI_DATA | TM_AUTO_CMD12 | TM_DAT_DIR_HC, RESP_R1, RCA_NO, 0},
     {"PROGRAM_CSD", 0x1B000000 | CMD_RSPNS_48, RESP_R1, RCA_NO, 0},
     {"SET_WRITE_PR", 0x1C000000 | CMD_RSPNS_48B, RESP_R1b, RCA_NO, 0},
     {"CLR_WRITE_PR", 0x1D000000 | CMD_RSPNS_48B, RESP_R1b, RCA_NO, 0},
@@ -500,8 +503,16 @@ static int sdBaseClock;
 struct buf sdque;
 struct SpinLock sdlock;
 
+// the request the card is working on, NULL if it is idle. Protected by
+// `sdlock`. The I/O thread sleeps on it.
+static buf *sd_active;
+
+// data phases are moved by this DMA channel, along the control blocks of
+// `sd_active`.
+#define SD_DMA_CHANNEL 4
+static DmaControlBlock sd_cbs[SD_MAX_BLOCKS];
+
 static void sd_waitdone(buf *b);
-static void sd_doit(buf *b);
 
 void sd_init() {
     /*
@@ -511,6 +522,7 @@ void sd_init() {
     sdInit();
     init_sdbuf();
     init_spinlock(&sdlock, "sdlock");
+    init_dma_channel(SD_DMA_CHANNEL);
     set_interrupt_handler(IRQ_SDIO, sd_intr);
     set_interrupt_handler(IRQ_ARASANSDIO, sd_intr);
     /*
@@ -523,7 +535,9 @@ void sd_init() {
     buf mbr;
     mbr.flags = (int)0;
     mbr.blockno = (u32)0;
-    sd_start(&mbr, true);
+    mbr.nblocks = 1;
+    mbr.blocks = NULL;
+    sd_start(&mbr);
     sd_waitdone(&mbr);
     printf("\n \
 ==> SD initialization \
@@ -543,162 +557,203 @@ static void sd_delayus(u32 c) {
     delayus(c * 3);
 }
 
-/* Start data transfer for b. */
-static void sd_doit(buf *b) {
-    int write = b->flags & B_DIRTY;
-    int done = 0, resp;
-    u32 *intbuf = (u32 *)b->data;
-    asserts((((i64)b->data) & 0x03) == 0, "Only support word-aligned buffers. ");
-
-    if (write) {
-        // Wait for ready interrupt for the next block.
-        if ((resp = sdWaitForInterrupt(INT_WRITE_RDY))) {
-            // printf("\n[sd_start] sdWaitForInterrupt resp: %x\n", resp);
-            PANIC("* EMMC ERROR: Timeout waiting for ready to write\n");
-            // return sdDebugResponse(resp);
-        }
-        asserts(!*EMMC_INTERRUPT, "%d ", *EMMC_INTERRUPT);
-        while (done < 128)
-            *EMMC_DATA = intbuf[done++];
-    }
+/* Address of the i-th block of b. */
+static u8 *sd_block(buf *b, usize i) {
+    return b->blocks ? b->blocks[i] : b->data;
+}
 
-    else {
-        if ((resp = sdWaitForInterrupt(INT_READ_RDY))) {
-            // printf("\n[sd_start] sdWaitForInterrupt resp: %x\n", resp);
-            PANIC("* EMMC ERROR: Timeout waiting for ready to read\n");
+/*
+ * Describe the data phase of b for the DMA engine: one control block per
+ * run of blocks adjacent in memory, paced by the EMMC DREQ. Buffers are
+ * written back, or dropped from the cache for reads, on the way.
+ */
+static usize sd_build_chain(buf *b, bool write) {
+    u32 port = dma_bus_address((void *)EMMC_DATA);
+    usize num_cbs = 0;
+
+    for (usize i = 0; i < b->nblocks; i++) {
+        u8 *addr = sd_block(b, i);
+        asserts(((u64)addr & (CACHE_LINE_SIZE - 1)) == 0, "Only support cache-line-aligned buffers. ");
+        if (write)
+            arch_clean_dcache(addr, BSIZE);
+        else
+            arch_flush_dcache(addr, BSIZE);
+
+        u32 bus = dma_bus_address(addr);
+        DmaControlBlock *cb = num_cbs ? &sd_cbs[num_cbs - 1] : NULL;
+        if (cb && (write ? cb->source_ad : cb->dest_ad) + cb->txfr_len == bus) {
+            cb->txfr_len += BSIZE;
+            continue;
         }
-        asserts(!*EMMC_INTERRUPT, "%d ", *EMMC_INTERRUPT);
-        while (done < 128)
-            intbuf[done++] = *EMMC_DATA;
+
+        cb = &sd_cbs[num_cbs++];
+        cb->ti = DMA_TI_PERMAP(DMA_PERMAP_EMMC) | DMA_TI_WAIT_RESP |
+                 (write ? DMA_TI_SRC_INC | DMA_TI_DEST_DREQ : DMA_TI_DEST_INC | DMA_TI_SRC_DREQ);
+        cb->source_ad = write ? bus : port;
+        cb->dest_ad = write ? port : bus;
+        cb->txfr_len = BSIZE;
+        cb->stride = 0;
     }
+    return num_cbs;
 }
 
 /* Start the request for b. Caller must hold sdlock. */
-static void sd_start(struct buf *b, bool Transfer) {
+static void sd_start(struct buf *b) {
     // Address is different depending on the card type.
     // HC pass address as block #.
     // SC pass address straight through.
     int bno = sdCard.type == SD_TYPE_2_HC ? (int)b->blockno : (int)b->blockno << 9;
     int write = b->flags & B_DIRTY;
 
-    // printf("- sd start: cpu %d, flag 0x%x, bno %d, write=%d\n", cpuid(), b->flags, bno, write);
+    trace_event(TRACE_SD_START, b->blockno, (u64)b->flags);
 
     disb();
     // Ensure that any data operation has completed before doing the transfer.
     asserts(!(b->flags & B_VALID), "valid buf should not be here.");
     asserts(!*EMMC_INTERRUPT, "emmc interrupt flag should be empty: 0x%x. ", *EMMC_INTERRUPT);
+    asserts(b->nblocks > 0 && b->nblocks <= SD_MAX_BLOCKS, "bad request of %d blocks", b->nblocks);
     disb();
 
+    usize num_cbs = sd_build_chain(b, write);
+
     // Work out the status, interrupt and command values for the transfer.
-    int cmd = write ? IX_WRITE_SINGLE : IX_READ_SINGLE;
+    // Multi-block commands are stopped by an automatic CMD12.
+    int cmd = b->nblocks > 1 ? (write ? IX_WRITE_MULTI : IX_READ_MULTI)
+                             : (write ? IX_WRITE_SINGLE : IX_READ_SINGLE);
     int resp;
-    *EMMC_BLKSIZECNT = 512;
+    *EMMC_BLKSIZECNT = (b->nblocks << 16) | BSIZE;
 
     if ((resp = sdSendCommandA(cmd, bno))) {
-        // printf("\n[sd_start] resp: %d\n", resp);
         PANIC("* EMMC send command error.");
     }
-
-    asserts((((i64)b->data) & 0x03) == 0, "Only support word-aligned buffers. ");
-    if (Transfer)
-        sd_doit(b);
-    // printf("\n[sd_start] b:(%p) end\n", b);
+    dma_start(SD_DMA_CHANNEL, sd_cbs, num_cbs);
 }
 
+/* Wait for the data phase of b to end. Caller must hold sdlock. */
 static void sd_waitdone(buf *b) {
     int resp;
     if ((resp = sdWaitForInterrupt(INT_DATA_DONE))) {
-        PANIC("* EMMC ERROR: Timeout waiting for ready to read\n");
+        PANIC("* EMMC ERROR: Timeout waiting for data done\n");
+    }
+    // the card may be done before the engine has drained the FIFO.
+    dma_wait(SD_DMA_CHANNEL);
+    // the engine has served these on its own.
+    *EMMC_INTERRUPT = INT_READ_RDY | INT_WRITE_RDY;
+
+    if (!(b->flags & B_DIRTY)) {
+        for (usize i = 0; i < b->nblocks; i++) {
+            arch_flush_dcache(sd_block(b, i), BSIZE);
+        }
     }
     b->flags = B_VALID;
     wakeup(b);
 }
 
-/* The interrupt handler. */
+/*
+ * The top half of the interrupt handler. It only finishes the request that
+ * raised the interrupt, whose data the DMA engine has already moved. The
+ * next request, if any, is started by `sd_io_thread`.
+ */
 void sd_intr() {
-    /*
-     * Pay attention to whether there is any element in the buflist.
-
-     * Understand the meanings of EMMC_INTERRUPT, EMMC_DATA, INT_DATA_DONE,
-     * INT_READ_RDY, B_DIRTY, B_VALID and some other flags.
-     *
-     * Notice that reading and writing are different, you can use flags
-     * to identify.
-     *
-     * Remember to clear the flags after reading/writing.
-     *
-     * When finished, remember to use pop and check whether the list is
-     * empty, if not, continue to read/write.
-     *
-     * You may use some buflist functions, disb(), sd_start(), wakeup() and
-     * sdWaitForInterrupt() to complete this function.
-     */
-    buf *b = NULL;
     disb();
     acquire_spinlock(&sdlock);
     disb();
-    // printf("\n[sd_intr] entry, EMMC_INTERRUPT: %x\n", *EMMC_INTERRUPT);
-
-    int read;
-    b = fetch_task();
-    assert(b->flags != B_VALID);
-    read = !b->flags;
-    // printf("\n[sd_intr] b: %p\n", b);
-    if (read)
-        sd_doit(b);
+    trace_event(TRACE_SD_INTR, *EMMC_INTERRUPT, 0);
+
+    buf *b = fetch_task();
+    asserts(b != NULL && b == sd_active, "[sd_intr] no request in flight");
     sd_waitdone(b);
-    disb();
-    // printf("\n[sd_intr] do once, EMMC_INTERRUPT: %x\n", *EMMC_INTERRUPT);
-    b = fetch_task();
-
-    // printf("\n[sd_intr] b: %p\n", b);
-    while(b != NULL) {
-        sd_start(b, true);
-        sd_waitdone(b);
-        b = fetch_task();
-        // printf("\n[sd_intr] do more, EMMC_INTERRUPT: %x\n", *EMMC_INTERRUPT);
-    }
-    // printf("\n[sd_intr] hello\n");
+    sd_active = NULL;
     asserts(!*EMMC_INTERRUPT, "[sd_intr] Interrupt should zero");
+
+    if (try_fetch_task())
+        wakeup(&sd_active);
     disb();
     release_spinlock(&sdlock);
-    yield();
+
+    // the waiter may be bound to this core: switch to it on the way out
+    // instead of when the time slice runs out.
+    thiscpu()->need_resched = true;
 }
 
 /*
- * Sync buf with disk.
- * If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
- * Else if B_VALID is not set, read buf from disk, set B_VALID.
+ * The bottom half: start queued requests one at a time, whenever the
+ * card has become idle.
  */
-void sdrw(struct buf *b) {
-    /* 
-     * Add to the list, if list is empty, then use sd_start
-     * then sleep, use loop to check whether buf flag is modified, if modified, then break
-     */
-    // printf("\n[sdrw] b(%p)\n", b);
+static void sd_io_thread(u64 arg) {
+    (void)arg;
+    acquire_spinlock(&sdlock);
+    while (true) {
+        buf *b = try_fetch_task();
+        if (b == NULL || sd_active != NULL) {
+            sleep(&sd_active, &sdlock);
+            continue;
+        }
+        sd_active = b;
+        sd_start(b);
+    }
+}
+
+/*
+ * Start the I/O thread, bound to the core after the one taking interrupts
+ * (see `set_interrupt_route`).
+ */
+void spawn_sd_io_thread() {
+    create_kthread("sdio", sd_io_thread, 0, (isize)((interrupt_route() + 1) % NCPU));
+}
+
+/* Queue b and sleep until it is done. */
+static void sd_submit(struct buf *b) {
     asserts(!*EMMC_INTERRUPT, "emmc interrupt flag should be empty: 0x%x. ", *EMMC_INTERRUPT);
-    int flags = b->flags, read = !flags;
-    if (flags == B_VALID)
-        return;
 
     disb();
     acquire_spinlock(&sdlock);
     disb();
 
-    if (!try_fetch_task()) {
-        if (read)
-            sd_start(b, false);
-        else 
-            sd_start(b, true);
-    }
+    // an idle card takes the request right away, otherwise the I/O thread
+    // starts it after the ones in front of it.
+    bool idle = sd_active == NULL && try_fetch_task() == NULL;
     add_task(b);
+    if (idle) {
+        sd_active = b;
+        sd_start(b);
+    }
     disb();
+
+    while (!(b->flags & B_VALID)) {
+        sleep(b, &sdlock);
+    }
     release_spinlock(&sdlock);
-    disb();
+}
+
+/*
+ * Sync buf with disk.
+ * If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+ * Else if B_VALID is not set, read buf from disk, set B_VALID.
+ */
+void sdrw(struct buf *b) {
+    if (b->flags == B_VALID)
+        return;
+    b->nblocks = 1;
+    b->blocks = NULL;
+    sd_submit(b);
+}
 
-    sleep(b, NULL);
-    asserts(b->flags & B_VALID, "flag should be valid after being waken.");
-}   
+/*
+ * Read or write `num_blocks` consecutive blocks from `block_no`, with one
+ * multi-block command for every `SD_MAX_BLOCKS` of them. Block i is moved
+ * straight from or to `blocks[i]`, which must be cache-line aligned.
+ */
+void sdrw_blocks(u32 block_no, usize num_blocks, u8 **blocks, bool write) {
+    for (usize i = 0; i < num_blocks; i += SD_MAX_BLOCKS) {
+        struct buf b;
+        b.flags = write ? B_DIRTY : 0;
+        b.blockno = block_no + (u32)i;
+        b.nblocks = (u32)MIN(num_blocks - i, (usize)SD_MAX_BLOCKS);
+        b.blocks = blocks + i;
+        sd_submit(&b);
+    }
+}
 
 /* SD card test and benchmark. */
 void sd_test() {
@@ -1237,8 +1292,8 @@ static int sdResetCard(int resetType) {
     // Enable interrupts for command completion values.
     // *EMMC_IRPT_EN   = INT_ALL_MASK;
     // *EMMC_IRPT_MASK = INT_ALL_MASK;
-    // Ignore INT_CMD_DONE and INT_WRITE_RDY.
-    *EMMC_IRPT_EN = 0xffffffff & (u32)(~INT_CMD_DONE) & (~(u32)INT_WRITE_RDY);
+    // Ignore INT_CMD_DONE, and INT_READ_RDY and INT_WRITE_RDY, which pace the DMA engine.
+    *EMMC_IRPT_EN = 0xffffffff & (u32)(~INT_CMD_DONE) & (~(u32)INT_READ_RDY) & (~(u32)INT_WRITE_RDY);
     *EMMC_IRPT_MASK = 0xffffffff;
     // printf("EMMC: Interrupt enable/mask registers: %08x %08x\n",*EMMC_IRPT_EN,*EMMC_IRPT_MASK);
     // printf("EMMC: Status: %08x, control: %08x %08x %08x\n",*EMMC_STATUS,*EMMC_CONTROL0,*EMMC_CONTROL1,*EMMC_CONTROL2);
@@ -18,7 +18,15 @@
 #define SD_READ_BLOCKS  0
 #define SD_WRITE_BLOCKS 1
 
+/*
+ * Most blocks moved by one command, i.e. one DMA control-block chain. A full
+ * log (`LOG_MAX_SIZE` blocks) goes out as one command.
+ */
+#define SD_MAX_BLOCKS 64
+
 void sd_init();
 void sd_intr();
+void spawn_sd_io_thread();
 void sd_test();
 void sdrw(struct buf *);
+void sdrw_blocks(u32 block_no, usize num_blocks, u8 **blocks, bool write);
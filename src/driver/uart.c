@@ -6,6 +6,27 @@
 #include <driver/interrupt.h>
 #include <driver/uart.h>
 
+#define AUX_MU_IER_RX       ((3 << 2) | 1)
+#define AUX_MU_IER_TX       (1 << 1)
+#define AUX_MU_LSR_TX_READY 0x20
+
+// the transmit ring.
+//
+// producers reserve consecutive slots by advancing `head` atomically, fill
+// them and then mark them as ready. At most one CPU drains the ring at a
+// time, either the UART interrupt handler or a producer flushing on its way
+// out. The drainer only ever polls the UART, so holding `draining` never
+// blocks other CPUs for long.
+typedef struct {
+    u64 head;     // next slot to reserve.
+    u64 tail;     // next slot to send.
+    bool draining;
+    bool ready[UART_TX_BUFFER_SIZE];
+    char data[UART_TX_BUFFER_SIZE];
+} UartTxRing;
+
+static UartTxRing tx;
+
 void init_uart() {
     device_put_u32(GPPUD, 0);
     delay_us(5);
@@ -17,8 +38,9 @@ void init_uart() {
     device_put_u32(AUX_ENABLES, 1);
     // disable auto flow control, receiver and transmitter (for now).
     device_put_u32(AUX_MU_CNTL_REG, 0);
-    // enable receiving interrupts.
-    device_put_u32(AUX_MU_IER_REG, 3 << 2 | 1);
+    // enable receiving interrupts. Transmitting interrupts are enabled only
+    // while the transmit ring is not empty.
+    device_put_u32(AUX_MU_IER_REG, AUX_MU_IER_RX);
     // enable 8-bit mode.
     device_put_u32(AUX_MU_LCR_REG, 3);
     // set RTS line to always high.
@@ -41,8 +63,12 @@ char uart_get_char() {
     return device_get_u32(AUX_MU_IO_REG) & 0xff;
 }
 
+static INLINE bool uart_tx_ready() {
+    return device_get_u32(AUX_MU_LSR_REG) & AUX_MU_LSR_TX_READY;
+}
+
 void uart_put_char(char c) {
-    while (!(device_get_u32(AUX_MU_LSR_REG) & 0x20)) {}
+    while (!uart_tx_ready()) {}
 
     device_put_u32(AUX_MU_IO_REG, c);
 
@@ -51,8 +77,83 @@ void uart_put_char(char c) {
         uart_put_char('\r');
 }
 
+// send ready characters until the ring is empty or an unfinished slot is
+// reached. If `sync` is false, also stop when the UART FIFO is full.
+static void uart_drain(bool sync) {
+    while (!__atomic_test_and_set(&tx.draining, __ATOMIC_SEQ_CST)) {
+        u64 tail = tx.tail;
+        while (tail != __atomic_load_n(&tx.head, __ATOMIC_ACQUIRE)) {
+            usize i = tail & (UART_TX_BUFFER_SIZE - 1);
+            if (!__atomic_load_n(&tx.ready[i], __ATOMIC_ACQUIRE))
+                break;
+            if (!uart_tx_ready()) {
+                if (!sync)
+                    break;
+                continue;
+            }
+
+            device_put_u32(AUX_MU_IO_REG, (u32)tx.data[i]);
+            __atomic_store_n(&tx.ready[i], false, __ATOMIC_RELAXED);
+            __atomic_store_n(&tx.tail, ++tail, __ATOMIC_RELEASE);
+        }
+
+        // let the interrupt continue with whatever is left.
+        bool pending = tail != __atomic_load_n(&tx.head, __ATOMIC_ACQUIRE);
+        device_put_u32(AUX_MU_IER_REG, AUX_MU_IER_RX | (pending ? AUX_MU_IER_TX : 0));
+
+        __atomic_clear(&tx.draining, __ATOMIC_SEQ_CST);
+
+        // a producer that failed to take `draining` after publishing relies
+        // on us to see its characters.
+        usize i = tail & (UART_TX_BUFFER_SIZE - 1);
+        if (!__atomic_load_n(&tx.ready[i], __ATOMIC_SEQ_CST) || !(sync || uart_tx_ready()))
+            break;
+    }
+}
+
+void uart_write(const char *str, usize n) {
+    // every '\n' is followed by a '\r'.
+    usize size = n;
+    for (usize i = 0; i < n; i++) {
+        if (str[i] == '\n')
+            size++;
+    }
+    assert(size <= UART_TX_BUFFER_SIZE);
+
+    u64 slot = __atomic_fetch_add(&tx.head, size, __ATOMIC_RELAXED);
+
+    // the ring is full: help draining it.
+    while (slot + size - __atomic_load_n(&tx.tail, __ATOMIC_ACQUIRE) > UART_TX_BUFFER_SIZE) {
+        uart_drain(true);
+    }
+
+    for (usize i = 0; i < n; i++) {
+        tx.data[slot++ & (UART_TX_BUFFER_SIZE - 1)] = str[i];
+        if (str[i] == '\n')
+            tx.data[slot++ & (UART_TX_BUFFER_SIZE - 1)] = '\r';
+    }
+    for (slot -= size; size > 0; size--, slot++) {
+        __atomic_store_n(&tx.ready[slot & (UART_TX_BUFFER_SIZE - 1)], true, __ATOMIC_SEQ_CST);
+    }
+
+    // fill the UART FIFO right away. This never waits for the UART.
+    uart_drain(false);
+}
+
+void uart_flush() {
+    while (__atomic_load_n(&tx.tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&tx.head, __ATOMIC_ACQUIRE)) {
+        uart_drain(true);
+    }
+}
+
 void uart_intr() {
-    for (int stat; !((stat = (int)get32(AUX_MU_IIR_REG)) & 1);)
+    for (int stat; !((stat = (int)get32(AUX_MU_IIR_REG)) & 1);) {
         if ((stat & 6) == 4)
             printf("%c", get32(AUX_MU_IO_REG) & 0xFF);
+        else if ((stat & 6) == 2) {
+            uart_drain(false);
+            if (!(get32(AUX_MU_IER_REG) & AUX_MU_IER_TX))
+                break;
+        }
+    }
 }
@@ -2,7 +2,20 @@
 
 #include <common/defines.h>
 
+// size of the transmit ring. Must be a power of two.
+#define UART_TX_BUFFER_SIZE 4096
+
 void init_uart();
 char uart_get_char();
+
+// write `c` synchronously, bypassing the transmit ring.
 void uart_put_char(char c);
-void uart_intr();
\ No newline at end of file
+
+// queue `n` characters for transmission and return without waiting for the
+// UART, unless the ring is full. Characters of one call are kept together.
+void uart_write(const char *str, usize n);
+
+// wait until all queued characters have been sent.
+void uart_flush();
+
+void uart_intr();
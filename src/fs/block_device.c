@@ -1,7 +1,18 @@
 #include <fs/block_device.h>
 #include <driver/sd.h>
 
+// the SD driver moves data straight from and to cache-line-aligned buffers
+// by DMA. Others go through the buffer of a `struct buf`.
+static bool dma_capable(u8 *buffer) {
+    return ((u64)buffer & (CACHE_LINE_SIZE - 1)) == 0;
+}
+
 static void sd_read(usize block_no, u8 *buffer) {
+    if (dma_capable(buffer)) {
+        sdrw_blocks((u32)block_no, 1, &buffer, false);
+        return;
+    }
+
     struct buf b;
     b.blockno = (u32)block_no;
     b.flags = 0;
@@ -9,15 +20,55 @@ static void sd_read(usize block_no, u8 *buffer) {
     memcpy(buffer, b.data, BLOCK_SIZE);
 }
 
+// blocks per read command. The pointers to them live on the stack.
+#define READ_CHUNK 16
+
+// one multi-block command, and one DMA chain, per `READ_CHUNK` blocks.
+static void sd_read_blocks(usize block_no, usize num_blocks, u8 *buffer) {
+    if (!dma_capable(buffer)) {
+        for (usize i = 0; i < num_blocks; i++) {
+            sd_read(block_no + i, buffer + i * BLOCK_SIZE);
+        }
+        return;
+    }
+
+    u8 *blocks[READ_CHUNK];
+    for (usize i = 0; i < num_blocks; i += READ_CHUNK) {
+        usize n = MIN(num_blocks - i, (usize)READ_CHUNK);
+        for (usize j = 0; j < n; j++) {
+            blocks[j] = buffer + (i + j) * BLOCK_SIZE;
+        }
+        sdrw_blocks((u32)(block_no + i), n, blocks, false);
+    }
+}
+
 static void sd_write(usize block_no, u8 *buffer) {
+    if (dma_capable(buffer)) {
+        sdrw_blocks((u32)block_no, 1, &buffer, true);
+        return;
+    }
+
     struct buf b;
     b.blockno = (u32)block_no;
-    b.flags = B_DIRTY | B_VALID;
+    b.flags = B_DIRTY;
     memcpy(b.data, buffer, BLOCK_SIZE);
     sdrw(&b);
 }
 
-static u8 sblock_data[BLOCK_SIZE];
+// gathered from all `buffers` by one DMA chain per `SD_MAX_BLOCKS` blocks.
+static void sd_write_blocks(usize block_no, usize num_blocks, u8 **buffers) {
+    for (usize i = 0; i < num_blocks; i++) {
+        if (!dma_capable(buffers[i])) {
+            for (usize j = 0; j < num_blocks; j++) {
+                sd_write(block_no + j, buffers[j]);
+            }
+            return;
+        }
+    }
+    sdrw_blocks((u32)block_no, num_blocks, buffers, true);
+}
+
+static u8 sblock_data[BLOCK_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
 BlockDevice block_device;
 
 void init_block_device() {
@@ -25,7 +76,9 @@ void init_block_device() {
     sd_read(MBR_START, sblock_data);
 
     block_device.read = sd_read;
+    block_device.read_blocks = sd_read_blocks;
     block_device.write = sd_write;
+    block_device.write_blocks = sd_write_blocks;
 }
 
 const SuperBlock *get_super_block() {
@@ -9,9 +9,17 @@ typedef struct {
     // caller must guarantee `buffer` is large enough.
     void (*read)(usize block_no, u8 *buffer);
 
+    // read `num_blocks` consecutive blocks starting at `block_no` to `buffer`.
+    // caller must guarantee `buffer` holds `num_blocks * BLOCK_SIZE` bytes.
+    void (*read_blocks)(usize block_no, usize num_blocks, u8 *buffer);
+
     // write `BLOCK_SIZE` bytes from `buffer` to block at `block_no`.
     // caller must guarantee `buffer` contains at least `BLOCK_SIZE` bytes.
     void (*write)(usize block_no, u8 *buffer);
+
+    // write `num_blocks` consecutive blocks starting at `block_no`, the i-th
+    // one from `buffers[i]`.
+    void (*write_blocks)(usize block_no, usize num_blocks, u8 **buffers);
 } BlockDevice;
 
 extern BlockDevice block_device;
@@ -4,6 +4,7 @@
 #include <core/console.h>
 #include <core/physical_memory.h>
 #include <core/proc.h>
+#include <core/trace.h>
 #include <fs/cache.h>
 #include <fs/cache_queue.h>
 
@@ -18,9 +19,17 @@ static Arena arena;       // memory pool for `Block` struct.
 static usize outstanding; // how many syscall is made.
 static usize end_pending; // end_op but have not commit yet.
 static usize cached_num;  // total cached block number.
+static SpinLock payload_lock; // protects `free_payloads`.
+static u8 *free_payloads; // free payloads, chained through their first bytes.
 
 static void unsafe_crash_recover(bool _safe);
 
+// the log is written by one device request.
+_Static_assert(LOG_MAX_SIZE <= SD_MAX_BLOCKS, "log does not fit one SD command");
+
+// number of log blocks replayed per device read: one page of them.
+#define REPLAY_BATCH (PAGE_SIZE / BLOCK_SIZE)
+
 // hint: you may need some other variables. Just add them here.
 
 // read the content from disk.
@@ -58,6 +67,8 @@ void init_bcache(const SuperBlock *_sblock, const BlockDevice *_device) {
     init_spinlock(&lock, "general lock for block cache");
     _cache_debug = false;
     cached_num = 0;
+    init_spinlock(&payload_lock, "block payloads");
+    free_payloads = NULL;
     end_pending = 0;
     // printf("\nlock addr -> %p\n", &lock);
 
@@ -65,9 +76,39 @@ void init_bcache(const SuperBlock *_sblock, const BlockDevice *_device) {
     unsafe_crash_recover(true);
 }
 
-// exile cached block from arena.
-void exile_cache(Block *blk) {
+// caller must hold `payload_lock`.
+static void unsafe_free_payload(u8 *payload) {
+    *(u8 **)payload = free_payloads;
+    free_payloads = payload;
+}
+
+// the pool grows a page at a time, and keeps its pages: the cache itself is
+// small (see `EVICTION_THRESHOLD`).
+static u8 *alloc_payload() {
+    acquire_spinlock(&payload_lock);
+    if (free_payloads == NULL) {
+        u8 *page = kalloc();
+        for (usize i = 0; i < PAGE_SIZE; i += BLOCK_SIZE)
+            unsafe_free_payload(page + i);
+    }
+    u8 *payload = free_payloads;
+    free_payloads = *(u8 **)payload;
+    release_spinlock(&payload_lock);
+    return payload;
+}
+
+static void free_block(RcuHead *head) {
+    Block *blk = container_of(head, Block, rcu);
+    acquire_spinlock(&payload_lock);
+    unsafe_free_payload(blk->data);
+    release_spinlock(&payload_lock);
     free_object(blk);
+}
+
+// exile cached block from arena. Lockless lookups may still see it, so it
+// is freed after a grace period.
+void exile_cache(Block *blk) {
+    call_rcu(&blk->rcu, free_block);
     cached_num -= 1;
 }
 
@@ -77,9 +118,11 @@ static void init_block(Block *block) {
     block->acquired = false;
     block->pinned = false;
     block->valid = false;
+    init_rc(&block->rc);
     init_list_node(&block->node);
-    init_sleeplock(&block->lock, "block");
-    memset(&(block->data), 0, sizeof(block->data));
+    init_mutex(&block->lock, "block");
+    // the payload is read from the device right after.
+    block->data = alloc_payload();
 }
 
 // see `cache.h`.
@@ -87,27 +130,52 @@ usize get_num_cached_blocks() {
     return cached_num;
 }
 
+// find block `block_no` under RCU and take a reference to it, so that it
+// is not evicted until `cache_release`. Return NULL on a miss, or if the
+// block is being evicted.
+static Block *pin_cached(usize block_no) {
+    rcu_read_lock();
+    Block *blk = get_cache(block_no);
+    if (blk != NULL && !increment_rc_not_zero(&blk->rc))
+        blk = NULL;
+    rcu_read_unlock();
+    return blk;
+}
+
+// lock a pinned block for the caller.
+static Block *lock_block(Block *blk, bool hit) {
+    acquire_mutex(&(blk->lock));
+    blk->acquired = true;
+    trace_event(TRACE_BCACHE_ACQUIRE, blk->block_no, hit);
+    return blk;
+}
+
 /* caller should hold the lock */
 static Block *unsafe_cache_acquire(usize block_no, bool _safe) {
-    Block *blk = NULL;
-    if (_safe) 
+    // hits neither take `lock` nor write anything shared but the block.
+    Block *blk = pin_cached(block_no);
+    if (blk != NULL)
+        return lock_block(blk, true);
+
+    if (_safe)
         acquire_spinlock(&lock);
-    while(1) {
-        blk = get_cache(block_no);
-        if (blk == NULL) {
-            blk = (Block *)alloc_object(&arena);
-            init_block(blk);
-            insert_cache(blk);
-            
-            cached_num += 1;
-            blk->valid = true;
-            blk->block_no = block_no;
-            device->read(block_no, &blk->data);
-        }
-        if (blk != NULL) break;
+    // blocks are only inserted and evicted under `lock`.
+    blk = pin_cached(block_no);
+    bool hit = blk != NULL;
+    if (!hit) {
+        blk = (Block *)alloc_object(&arena);
+        init_block(blk);
+        blk->valid = true;
+        blk->block_no = block_no;
+        device->read(block_no, blk->data);
+
+        // one reference for the cache, one for the caller. Lookups may find
+        // it as soon as it is inserted.
+        increment_rc(&blk->rc);
+        increment_rc(&blk->rc);
+        insert_cache(blk);
+        cached_num += 1;
     }
-    acquire_sleeplock(&(blk->lock));
-    blk->acquired = true;
 
     if (_cache_debug) 
         printf("\n \033[46;37;5m cache_acquire \033[0m: now cached blocks: %d\n", get_num_cached_blocks());
@@ -115,18 +183,43 @@ static Block *unsafe_cache_acquire(usize block_no, bool _safe) {
         scavenger();
     if (_safe)
         release_spinlock(&lock);
-    return blk;
+    return lock_block(blk, hit);
 }
 
 // see `cache.h`.
 static Block *cache_acquire(usize block_no) {
-    unsafe_cache_acquire(block_no, true);
+    return unsafe_cache_acquire(block_no, true);
 }
 
 // see `cache.h`.
 static void cache_release(Block *block) {
     block->acquired = false;
-    release_sleeplock(&(block->lock));
+    release_mutex(&(block->lock));
+    // the cache keeps its own reference: only the scavenger drops the last.
+    decrement_rc(&block->rc);
+}
+
+// see `cache.h`.
+static void cache_read_blocks(const usize *block_nos, usize num_blocks, u8 *buffer) {
+    usize i = 0;
+    while (i < num_blocks) {
+        // a block cached now may be evicted before `cache_acquire`, which
+        // then reads it again. Uncached blocks are not modified by anyone.
+        bool cached = get_cache(block_nos[i]) != NULL;
+        usize j = i + 1;
+        while (!cached && j < num_blocks && block_nos[j] == block_nos[j - 1] + 1 &&
+               get_cache(block_nos[j]) == NULL) {
+            j++;
+        }
+
+        if (cached) {
+            Block *block = cache_acquire(block_nos[i]);
+            memcpy(buffer + i * BLOCK_SIZE, block->data, BLOCK_SIZE);
+            cache_release(block);
+        } else
+            device->read_blocks(block_nos[i], j - i, buffer + i * BLOCK_SIZE);
+        i = j;
+    }
 }
 
 // see `cache.h`.
@@ -175,48 +268,88 @@ static void cache_sync(OpContext *ctx, Block *block) {
     unsafe_cache_sync(ctx, block, true);
 }
 
-/* Kind reminder of Yikun: caller must hold lock. */
+// write `num_blocks` logged blocks to their homes `block_nos`, the i-th one
+// from `payloads[i]`. Runs of consecutive block numbers go to the device as
+// one request.
+static void install_blocks(const usize *block_nos, usize num_blocks, u8 **payloads) {
+    usize i = 0;
+    while (i < num_blocks) {
+        usize j = i + 1;
+        while (j < num_blocks && block_nos[j] == block_nos[j - 1] + 1) {
+            j++;
+        }
+        device->write_blocks(block_nos[i], j - i, payloads + i);
+        i = j;
+    }
+}
+
+/*
+ * Kind reminder of Yikun: caller must hold lock.
+ * Replay the log at mount time, a page of log blocks per device read.
+ */
 static void unsafe_crash_recover(bool _safe) {
     if (_safe)
         acquire_spinlock(&lock);
-    usize i;
-    u8 buffer[BLOCK_SIZE];
     usize start = sblock->log_start; 
+    u8 *buffer = kalloc();
+    u8 *payloads[REPLAY_BATCH];
     
     read_header();
     if (_cache_debug) {
         printf("\n %s: \033[45;37;5mcache_recover\033[0m: now %d blocks need to be transfered from logging area to data area \n", __FILE__, header.num_blocks);
         printf("\033[45;37;5mcache_recover\033[0m: starting transfer... \n");
     }
-    for (i = 0; i < header.num_blocks; i++) {
-        device->read(start + 1 + i, &(buffer));
-        device->write(header.block_no[i], &(buffer));
+    for (usize i = 0; i < header.num_blocks; i += REPLAY_BATCH) {
+        usize n = MIN(header.num_blocks - i, (usize)REPLAY_BATCH);
+        device->read_blocks(start + 1 + i, n, buffer);
+        for (usize j = 0; j < n; j++) {
+            payloads[j] = buffer + j * BLOCK_SIZE;
+        }
+        install_blocks(header.block_no + i, n, payloads);
     }
     header.num_blocks = (usize)0;
     write_header();
+    kfree(buffer);
 
     if (_safe)
         release_spinlock(&lock);
 }
 
+/*
+ * The log goes out as one multi-block write, followed by the header, which
+ * is the commit point. The cached copies of logged blocks are exactly what
+ * was logged, so they are installed from memory rather than read back from
+ * the log.
+ */
 static void commit() {
     Block *from;
     usize i;
     usize start = sblock->log_start; 
+    // kept off the stack, which `write_blocks` needs. Guarded by `lock`.
+    static u8 *payloads[LOG_MAX_SIZE];
 
+    trace_event(TRACE_BCACHE_COMMIT, header.num_blocks, 0);
     if (_cache_debug) {
         printf("\n%s: \033[43;37;5mcache_commit\033[0m: now overall pending tasks: %d \n", __FILE__, header.num_blocks);
         printf("\033[43;37;5mcache_commit\033[0m: starting writing logging area and header...\n");
     }
+    if (header.num_blocks == 0)
+        return;
 
+    // we hold `lock` until the end, so unpinned blocks are not evicted
+    // before they are installed.
     for (i = 0; i < header.num_blocks; i++) {
         from = get_cache(header.block_no[i]);
-        device->write(start + 1 + i, &(from->data)); 
+        payloads[i] = from->data;
         // unpin the block cache.
         from -> pinned = false;
     }
+    device->write_blocks(start + 1, header.num_blocks, payloads);
+    write_header();
+
+    install_blocks(header.block_no, header.num_blocks, payloads);
+    header.num_blocks = (usize)0;
     write_header();
-    unsafe_crash_recover(false);
 
     if (_cache_debug) {
         printf("\n%s: \033[44;37;5mcache_commit\033[0m: transfer done. \n", __FILE__);
@@ -251,9 +384,9 @@ static usize cache_alloc(OpContext *ctx) {
     for (blki = 0; blki < totblk; blki += BIT_PER_BLOCK) {
         Block *block = unsafe_cache_acquire(bitmap_start + blki/BIT_PER_BLOCK, false);
         for (blkj = 0; blkj < BIT_PER_BLOCK && blki + blkj < totblk; blkj++) {
-            if (bitmap_get(&(block->data), blkj) == false) {
+            if (bitmap_get((BitmapCell *)block->data, blkj) == false) {
 
-                bitmap_set(&(block->data), blkj);
+                bitmap_set((BitmapCell *)block->data, blkj);
                 block_no = blki + blkj;
                 unsafe_cache_sync(ctx, block, false);
                 cache_release(block);
@@ -281,10 +414,10 @@ static void cache_free(OpContext *ctx, usize block_no) {
     usize bitmap_start = sblock->bitmap_start;
     Block *block = unsafe_cache_acquire(bitmap_start + blki, false);
 
-    if (bitmap_get(&(block->data), blkj) == false) {
+    if (bitmap_get((BitmapCell *)block->data, blkj) == false) {
         PANIC("cache_free: trying free a free block");
     }
-    bitmap_clear(&(block->data), blkj);
+    bitmap_clear((BitmapCell *)block->data, blkj);
     unsafe_cache_sync(ctx, block, false);
     cache_release(block);
     release_spinlock(&lock);
@@ -294,6 +427,7 @@ BlockCache bcache = {
     .get_num_cached_blocks = get_num_cached_blocks,
     .acquire = cache_acquire,
     .release = cache_release,
+    .read_blocks = cache_read_blocks,
     .begin_op = cache_begin_op,
     .sync = cache_sync,
     .end_op = cache_end_op,
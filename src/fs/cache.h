@@ -1,7 +1,9 @@
 #pragma once
 
 #include <common/list.h>
-#include <core/sleeplock.h>
+#include <common/rc.h>
+#include <core/mutex.h>
+#include <core/rcu.h>
 #include <fs/block_device.h>
 #include <fs/defines.h>
 #include <driver/sd.h>
@@ -18,16 +20,27 @@
 // for example, if you want to implement LFU strategy instead, you can add a counter
 // inside `Block` to maintain the number of times it was accessed.
 typedef struct {
-    // accesses to the following 4 members should be guarded by the lock
-    // of the block cache.
+    // accesses to the following 3 members should be guarded by the lock
+    // of the block cache. `block_no` and `node` may also be read under RCU
+    // (see `get_cache`).
     usize block_no;
     ListNode node;
-    bool acquired;  // is the block already acquired by some thread?
     bool pinned;    // if a block is pinned, it should not be evicted from the cache.
 
-    SleepLock lock;  // this lock protects `valid` and `data`.
+    // one reference for the cache, plus one per thread acquiring or holding
+    // the block. Blocks still referenced by a thread are not evicted.
+    RefCount rc;
+    bool acquired;  // is the block already acquired by some thread? Guarded by `lock`.
+
+    Mutex lock;      // this lock protects `valid` and `data`.
     bool valid;      // is the content of block loaded from disk?
-    u8 data[BLOCK_SIZE];
+
+    // `BLOCK_SIZE` bytes, aligned to `BLOCK_SIZE`. Payloads are kept apart
+    // from the headers: eight share a page, and the headers stay small, so
+    // a scan of the cache list touches few cache lines.
+    u8 *data;
+
+    RcuHead rcu;  // an evicted block is freed after a grace period.
 } Block;
 
 // `OpContext` represents an atomic operation.
@@ -52,6 +65,15 @@ typedef struct BlockCache {
     // NOTE: it does not need to write the block content back to disk.
     void (*release)(Block *block);
 
+    // read blocks `block_nos[0..num_blocks)` to consecutive `BLOCK_SIZE`
+    // slots of `buffer`, without caching them. Cached blocks are copied from
+    // the cache, and each run of consecutive uncached blocks is read from
+    // the device in one request.
+    //
+    // NOTE: caller must make sure that nobody modifies these blocks meanwhile,
+    // e.g. by holding the lock of the inode they belong to.
+    void (*read_blocks)(const usize *block_nos, usize num_blocks, u8 *buffer);
+
     // NOTES FOR ATOMIC OPERATIONS
     //
     // atomic operation has three states:
@@ -1,5 +1,6 @@
 #include <fs/cache_queue.h>
 #include <core/arena.h>
+#include <core/rcu.h>
 #include <core/physical_memory.h>
 #include <common/spinlock.h>
 #include <common/list.h>
@@ -19,8 +20,7 @@ static SpinLock qlock;
 void 
 insert_cache(Block *blk) {
     acquire_spinlock(&qlock);
-    ListNode *node = &blk->node;
-    merge_list(&head.prev, node);
+    insert_into_list_rcu(&head, &blk->node);
     release_spinlock(&qlock);
 }
 
@@ -31,30 +31,29 @@ insert_cache(Block *blk) {
 static void 
 remove_cache(Block *blk) {
     // acquire_spinlock(&qlock);
-    ListNode *node = &blk->node;
-    detach_from_list(node);
+    detach_from_list_rcu(&blk->node);
     // release_spinlock(&qlock);    
 }
 
 /*
  * try getting from cache queue.  
+ * the queue is walked under RCU, without `qlock`. The block stays valid
+ * while the caller is in an RCU read-side section or holds the lock of the
+ * block cache, since only the scavenger evicts blocks and it runs under
+ * that lock. To keep it longer, take a reference (see `Block.rc`).
  */
 Block *
 get_cache(usize block_no) {
-    acquire_spinlock(&qlock);
-    Block *blk = NULL;
     Block *res = NULL;
-    ListNode *node = head.next;
-    
-    while(node != &head && res == NULL) {
-        blk = node2blk(node);
+    rcu_read_lock();
+    for (ListNode *node = list_next_rcu(&head); node != &head; node = list_next_rcu(node)) {
+        Block *blk = node2blk(node);
         if (blk->block_no == block_no) {
             res = blk;
+            break;
         }
-        node = node->next;
     }
-    
-    release_spinlock(&qlock);
+    rcu_read_unlock();
     return res;
 }
 
@@ -88,7 +87,11 @@ scavenger() {
     while(node != &head && get_num_cached_blocks() > EVICTION_THRESHOLD) {
         Block *blk = (Block *)node2blk(node);
         node = node->next;
-        if (blk->acquired == false && blk->pinned == false) {
+        // drop the reference of the cache, unless somebody else holds one.
+        isize only_cache = 1;
+        if (blk->pinned == false &&
+            __atomic_compare_exchange_n(
+                &blk->rc.count, &only_cache, 0, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
             remove_cache(blk);
             exile_cache(blk);
         }
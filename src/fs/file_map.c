@@ -0,0 +1,137 @@
+#include <common/string.h>
+#include <core/arena.h>
+#include <core/console.h>
+#include <core/physical_memory.h>
+#include <fs/file_map.h>
+
+static SpinLock lock;  // protects `head` and `num_users`.
+static ListNode head;  // all files with mapped pages.
+
+static const SuperBlock *sblock;
+static const BlockCache *cache;
+static Arena arena;
+
+void init_file_maps(const SuperBlock *_sblock, const BlockCache *_cache) {
+    ArenaPageAllocator allocator = {.allocate = kalloc, .free = kfree};
+
+    init_spinlock(&lock, "file maps");
+    init_list_node(&head);
+    sblock = _sblock;
+    cache = _cache;
+    init_arena(&arena, sizeof(FileMap), allocator);
+}
+
+// caller must hold `lock`.
+static FileMap *_find(usize inode_no) {
+    for (ListNode *node = head.next; node != &head; node = node->next) {
+        FileMap *map = container_of(node, FileMap, node);
+        if (map->inode->inode_no == inode_no)
+            return map;
+    }
+    return NULL;
+}
+
+FileMap *file_map_get(usize inode_no) {
+    if (cache == NULL || inode_no == 0 || inode_no >= sblock->num_inodes)
+        return NULL;
+
+    acquire_spinlock(&lock);
+    FileMap *map = _find(inode_no);
+    if (map)
+        map->num_users++;
+    release_spinlock(&lock);
+    if (map)
+        return map;
+
+    Inode *inode = inodes.get(inode_no);
+    inodes.lock(inode);
+    bool regular = inode->entry.type == INODE_REGULAR;
+    inodes.unlock(inode);
+    if (!regular) {
+        OpContext ctx;
+        cache->begin_op(&ctx);
+        inodes.put(&ctx, inode);
+        cache->end_op(&ctx);
+        return NULL;
+    }
+
+    FileMap *new_map = alloc_object(&arena);
+    if (new_map == NULL)
+        PANIC("file_map_get: arena fails to allocate new map.\n");
+    memset(new_map, 0, sizeof(FileMap));
+    init_list_node(&new_map->node);
+    init_mutex(&new_map->lock, "file map");
+    new_map->inode = inode;
+    new_map->num_users = 1;
+
+    // somebody may have mapped the file in the meantime.
+    acquire_spinlock(&lock);
+    map = _find(inode_no);
+    if (map)
+        map->num_users++;
+    else
+        merge_list(&head, &new_map->node);
+    release_spinlock(&lock);
+
+    if (map) {
+        free_object(new_map);
+        OpContext ctx;
+        cache->begin_op(&ctx);
+        inodes.put(&ctx, inode);
+        cache->end_op(&ctx);
+        return map;
+    }
+    return new_map;
+}
+
+void *file_map_page(FileMap *map, usize index) {
+    inodes.lock(map->inode);
+    void *page = inodes.get_page(map->inode, index);
+    inodes.unlock(map->inode);
+    return page;
+}
+
+void file_map_set_dirty(FileMap *map, usize index) {
+    acquire_mutex(&map->lock);
+    assert(index < INODE_MAX_PAGES);
+    map->dirty[index] = true;
+    release_mutex(&map->lock);
+}
+
+// one atomic operation per page keeps each within `OP_MAX_NUM_BLOCKS`.
+static void _write_back(FileMap *map, usize index) {
+    OpContext ctx;
+
+    cache->begin_op(&ctx);
+    inodes.lock(map->inode);
+    inodes.sync_page(&ctx, map->inode, index);
+    inodes.unlock(map->inode);
+    cache->end_op(&ctx);
+}
+
+void file_map_sync(FileMap *map) {
+    acquire_mutex(&map->lock);
+    for (usize i = 0; i < INODE_MAX_PAGES; i++) {
+        if (map->dirty[i])
+            _write_back(map, i);
+    }
+    release_mutex(&map->lock);
+}
+
+void file_map_put(FileMap *map) {
+    file_map_sync(map);
+
+    acquire_spinlock(&lock);
+    bool last = --map->num_users == 0;
+    if (last)
+        detach_from_list(&map->node);
+    release_spinlock(&lock);
+    if (!last)
+        return;
+
+    OpContext ctx;
+    cache->begin_op(&ctx);
+    inodes.put(&ctx, map->inode);
+    cache->end_op(&ctx);
+    free_object(map);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <common/list.h>
+#include <core/mutex.h>
+#include <fs/cache.h>
+#include <fs/inode.h>
+
+// regular files mapped into user address spaces.
+//
+// mappings use the pages of the page cache of the inode directly (see
+// `inodes.get_page`), so a file mapped into many processes is read once and
+// `inodes.write` is seen by every mapping. Each user mapping of a page holds
+// a reference to the page (see `kref`). Pages written through a mapping are
+// marked dirty and written back through the block cache by
+// `file_map_sync`, and when the last user of the file goes away.
+typedef struct {
+    ListNode node;
+    Inode *inode;
+    usize num_users;  // guarded by the lock of the list.
+
+    Mutex lock;  // protects `dirty`.
+    bool dirty[INODE_MAX_PAGES];
+} FileMap;
+
+void init_file_maps(const SuperBlock *sblock, const BlockCache *cache);
+
+// return the mapped pages of regular file `inode_no`, and count one more
+// user. Return NULL if the file cannot be mapped, or `inode_no` is out of range.
+FileMap *file_map_get(usize inode_no);
+
+// return page `index` of the file, with a new reference for the caller.
+// Return NULL if the page is beyond the end of the file. Bytes past the end
+// of the file read as zero.
+void *file_map_page(FileMap *map, usize index);
+
+// page `index` has been or is about to be written through a mapping.
+void file_map_set_dirty(FileMap *map, usize index);
+
+// write dirty pages back to the file. Pages stay dirty, since writable
+// mappings may still change them.
+void file_map_sync(FileMap *map);
+
+// write dirty pages back and count one user less. The inode is put with
+// the last user.
+void file_map_put(FileMap *map);
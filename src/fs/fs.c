@@ -1,6 +1,7 @@
 #include <fs/block_device.h>
 #include <fs/cache.h>
 #include <fs/defines.h>
+#include <fs/file_map.h>
 #include <fs/fs.h>
 #include <fs/inode.h>
 
@@ -10,4 +11,5 @@ void init_filesystem() {
     const SuperBlock *sblock = get_super_block();
     init_bcache(sblock, &block_device);
     init_inodes(sblock, &bcache);
+    init_file_maps(sblock, &bcache);
 }
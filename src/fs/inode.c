@@ -5,7 +5,7 @@
 #include <fs/inode.h>
 
 // this lock mainly prevents concurrent access to inode list `head`, reference
-// count increment and decrement.
+// count increment and decrement. Lookups walk the list under RCU instead.
 static SpinLock lock;
 static ListNode head;
 
@@ -14,17 +14,18 @@ static const BlockCache *cache;
 static Arena arena;
 
 // find inode in list.
-// NOTED : caller MUST hold the lock of the list !!!
+// NOTED : caller MUST hold the lock of the list, or be inside an RCU
+// read-side critical section !!!
 static INLINE Inode *get_inode_inlist(usize inode_no) {
     ListNode *head_pointer = (ListNode*) &head;
-    ListNode *current = head_pointer->next;
+    ListNode *current = list_next_rcu(head_pointer);
     Inode *inode = NULL;
     while(current != head_pointer) {
         inode = (Inode *) current;
         // corresponding inode is found in list.
         if (inode->inode_no == inode_no)
             return inode;
-        current = current->next;
+        current = list_next_rcu(current);
     }
     return NULL;
 }
@@ -68,11 +69,23 @@ void init_inodes(const SuperBlock *_sblock, const BlockCache *_cache) {
 
 // initialize in-memory inode.
 static void init_inode(Inode *inode) {
-    init_spinlock(&inode->lock, "inode");
+    init_mutex(&inode->lock, "inode");
     init_rc(&inode->rc);
     init_list_node(&inode->node);
     inode->inode_no = 0;
     inode->valid = false;
+    memset(inode->pages, 0, sizeof(inode->pages));
+}
+
+// drop the page cache of `inode`. Pages still mapped somewhere are freed
+// with their last mapping.
+static void drop_pages(Inode *inode) {
+    for (usize i = 0; i < INODE_MAX_PAGES; i++) {
+        if (inode->pages[i]) {
+            kfree(inode->pages[i]);
+            inode->pages[i] = NULL;
+        }
+    }
 }
 
 //
@@ -129,14 +142,14 @@ static usize inode_alloc(OpContext *ctx, InodeType type) {
 // see `inode.h`.
 static void inode_lock(Inode *inode) {
     assert(inode->rc.count > 0);
-    acquire_spinlock(&inode->lock);
+    acquire_mutex(&inode->lock);
 }
 
 // see `inode.h`.
 static void inode_unlock(Inode *inode) {
-    assert(holding_spinlock(&inode->lock));
+    assert(holding_mutex(&inode->lock));
     assert(inode->rc.count > 0);
-    release_spinlock(&inode->lock);
+    release_mutex(&inode->lock);
 }
 
 // 
@@ -191,19 +204,17 @@ static Inode *inode_get(usize inode_no) {
     assert(inode_no > 0);
     assert(inode_no < sblock->num_inodes);
 
-    // try to find the inode in list first.
+    // try to find the inode in list first, without the lock. An inode
+    // whose count dropped to zero is being put, and does not count.
     Inode *inode = NULL;
-    acquire_spinlock(&lock);
+    rcu_read_lock();
     inode = get_inode_inlist(inode_no);
-    release_spinlock(&lock);
-
-    // if inode has been in list.
-    if (inode != NULL) {
-        increment_rc(&inode->rc);
-    }
+    if (inode != NULL && !increment_rc_not_zero(&inode->rc))
+        inode = NULL;
+    rcu_read_unlock();
 
     // otherwise inode not in list. allocate and initliaze a new one.
-    else{
+    if (inode == NULL) {
         // allocate object using memory pool.
         inode = (Inode *)alloc_object(&arena);
         // PANIC if arena fail to allocate new Inode.
@@ -214,7 +225,7 @@ static Inode *inode_get(usize inode_no) {
         init_inode(inode);
 
         // aquire inode lock since we edit values on it && no caller holds the lock.
-        acquire_spinlock(&inode->lock);
+        acquire_mutex(&inode->lock);
 
         // inode_no & reference count edit.
         inode->inode_no = inode_no;
@@ -227,14 +238,22 @@ static Inode *inode_get(usize inode_no) {
 
         increment_rc(&inode->rc);
 
-        // aquire list lock since we want to edit the list.
+        // aquire list lock since we want to edit the list. Somebody else
+        // may have loaded the inode in the meantime.
         acquire_spinlock(&lock);
-        merge_list(&head, &inode->node);
+        Inode *other = get_inode_inlist(inode_no);
+        if (other != NULL)
+            increment_rc(&other->rc);
+        else
+            insert_into_list_rcu(&head, &inode->node);
         release_spinlock(&lock);
 
-
         // release lock of inode.
-        release_spinlock(&inode->lock);
+        release_mutex(&inode->lock);
+        if (other != NULL) {
+            free_object(inode);
+            inode = other;
+        }
     }
 
     // final check.
@@ -273,7 +292,7 @@ static void inode_clear(OpContext *ctx, Inode *inode) {
     if (im_entry->indirect && inode->valid == true) {
         Block *block = cache->acquire(im_entry->indirect);
         for (i=0; i<INODE_NUM_INDIRECT; i++) {
-            u32 *block_no_addr = (u32 *)block + i;
+            u32 *block_no_addr = get_addrs(block) + i;
 
             // if there is allocated data block in indirect block, free it.
             if (*block_no_addr) {
@@ -287,6 +306,7 @@ static void inode_clear(OpContext *ctx, Inode *inode) {
     }
     entry->indirect = (u32)0;
     entry->num_bytes = (u16)0;
+    drop_pages(inode);
     // now all contents has been discard.
 
     // finally synchronize entry to sd.
@@ -304,6 +324,10 @@ static Inode *inode_share(Inode *inode) {
     return inode;
 }
 
+static void free_inode(RcuHead *head) {
+    free_object(container_of(head, Inode, rcu));
+}
+
 //
 // see `inode.h`.
 // 0. Holding `inode -> lock`.
@@ -312,14 +336,20 @@ static Inode *inode_share(Inode *inode) {
 //
 static void inode_put(OpContext *ctx, Inode *inode) {
     // aquire inode's lock
-    acquire_spinlock(&inode->lock);
+    acquire_mutex(&inode->lock);
 
-    // decrease the reference count of inode.
-    decrement_rc(&inode->rc);
+    // decrease the reference count of inode. The last reference leaves
+    // together with the list entry, so `inode_get` never finds an inode
+    // with no references under the lock.
+    acquire_spinlock(&lock);
+    bool last = decrement_rc(&inode->rc);
+    if (last)
+        detach_from_list_rcu(&inode->node);
+    release_spinlock(&lock);
 
     // if ref number > 0, return.
-    if (inode->rc.count) {
-        release_spinlock(&inode->lock);
+    if (!last) {
+        release_mutex(&inode->lock);
         return;
     }
 
@@ -335,14 +365,11 @@ static void inode_put(OpContext *ctx, Inode *inode) {
         inode_sync(ctx, inode, true);
     }
 
-    // if entry.num_links > 0, only destroy inode in memory.
-    acquire_spinlock(&lock);
-    detach_from_list(&inode->node);
-    release_spinlock(&lock);
-    
-    release_spinlock(&inode->lock);
-
-    free_object(inode);
+    // if entry.num_links > 0, only destroy inode in memory. Lockless
+    // lookups may still see it until a grace period has elapsed.
+    drop_pages(inode);
+    release_mutex(&inode->lock);
+    call_rcu(&inode->rcu, free_inode);
 }
 
 // this function is private to inode layer, because it can allocate block
@@ -384,10 +411,17 @@ static usize inode_map(OpContext *ctx, Inode *inode, usize offset, bool *modifie
             *modified = true;
         }
 
-        // find corresponding entry position.
-        IndirectBlock *block = (IndirectBlock *)cache->acquire(entry->indirect);
-        block_entry = &block->addrs[block_index];
+        // find corresponding entry position, and allocate it while the
+        // indirect block is held.
+        Block *block = cache->acquire(entry->indirect);
+        block_entry = &get_addrs(block)[block_index];
+        if (*block_entry == 0) {
+            *block_entry = cache->alloc(ctx);
+            cache->sync(ctx, block);
+        }
+        block_no = *block_entry;
         cache->release(block);
+        return block_no;
     }
 
     // if entry is allocated before.
@@ -420,14 +454,73 @@ static usize inode_map2(Inode *inode, usize offset) {
     else {
         block_index -= INODE_NUM_DIRECT;
         assert(entry->indirect);
-        IndirectBlock *block = (IndirectBlock *)cache->acquire(entry->indirect);
-        if (block->addrs[block_index]);
-        usize block_no = block->addrs[block_index];
+        Block *block = cache->acquire(entry->indirect);
+        block_no = get_addrs(block)[block_index];
         cache->release(block);
+        assert(block_no);
         return block_no;
     }
 }
 
+// fill `block_nos` with the first `num_blocks` blocks of page `index`,
+// holding the indirect block once for the whole page.
+static void page_blocks(Inode *inode, usize index, usize *block_nos, usize num_blocks) {
+    InodeEntry *entry = &inode->entry;
+    usize first = index * BLOCKS_PER_PAGE;
+    Block *block = NULL;
+
+    for (usize i = 0; i < num_blocks; i++) {
+        usize block_index = first + i;
+        if (block_index < INODE_NUM_DIRECT) {
+            block_nos[i] = entry->addrs[block_index];
+        } else {
+            if (block == NULL) {
+                assert(entry->indirect);
+                block = cache->acquire(entry->indirect);
+            }
+            block_nos[i] = get_addrs(block)[block_index - INODE_NUM_DIRECT];
+        }
+        assert(block_nos[i]);
+    }
+
+    if (block)
+        cache->release(block);
+}
+
+// return page `index` of regular file `inode`, loading it if necessary.
+// the page cache keeps one reference to every page it holds.
+static u8 *cached_page(Inode *inode, usize index) {
+    InodeEntry *entry = &inode->entry;
+    usize offset = index * FILE_PAGE_SIZE;
+    assert(offset < entry->num_bytes);
+
+    if (inode->pages[index] == NULL) {
+        usize count = MIN((usize)FILE_PAGE_SIZE, entry->num_bytes - offset);
+        usize num_blocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        usize block_nos[BLOCKS_PER_PAGE];
+        u8 *page = kalloc();
+        if (page == NULL)
+            PANIC("cached_page: failed to allocate page.\n");
+
+        page_blocks(inode, index, block_nos, num_blocks);
+        cache->read_blocks(block_nos, num_blocks, page);
+        memset(page + count, 0, FILE_PAGE_SIZE - count);
+        inode->pages[index] = page;
+    }
+    return inode->pages[index];
+}
+
+// see `inode.h`.
+static void *inode_get_page(Inode *inode, usize index) {
+    assert(inode->entry.type == INODE_REGULAR);
+    if (index >= INODE_MAX_PAGES || index * FILE_PAGE_SIZE >= inode->entry.num_bytes)
+        return NULL;
+
+    u8 *page = cached_page(inode, index);
+    kref(page);
+    return page;
+}
+
 // see `inode.h`.
 // 0. not holding lock of inode.
 // 1. call cache's `acquire` to access the block.
@@ -440,6 +533,17 @@ static void inode_read(Inode *inode, u8 *dest, usize offset, usize count) {
     assert(end <= entry->num_bytes);
     assert(offset <= end);
 
+    // regular files are read a page at a time.
+    if (entry->type == INODE_REGULAR) {
+        for (usize i = round_down(offset, FILE_PAGE_SIZE); i < end; i += FILE_PAGE_SIZE) {
+            usize start = MAX(i, offset), term = MIN(i + FILE_PAGE_SIZE, end);
+            u8 *page = cached_page(inode, i / FILE_PAGE_SIZE);
+            memcpy(dest, page + (start - i), term - start);
+            dest += term - start;
+        }
+        return;
+    }
+
     usize i = round_down(offset, BLOCK_SIZE);
     usize start, term;
     while(i < end) {
@@ -450,7 +554,7 @@ static void inode_read(Inode *inode, u8 *dest, usize offset, usize count) {
         // begin copy.
         usize block_no = inode_map2(inode, i);
         Block *block = cache->acquire(block_no);
-        memcpy(dest, (u8 *)block + start, term-start);
+        memcpy(dest, block->data + start, term-start);
         cache->release(block);
         // update.
         dest += term-start;
@@ -458,17 +562,14 @@ static void inode_read(Inode *inode, u8 *dest, usize offset, usize count) {
     }
 }
 
-// see `inode.h`.
+// copy `count` bytes from `src` to the blocks of `inode` at `offset`,
+// allocating blocks on the way. Return whether any block is allocated.
 // 1. call cache's `acquire` to access the block.
 // 2. copy corresponding data from `src` to block.
 // 3. synchronize data to disk.
 // 3. do forget to `release` the block every time call `acquire`.
-static void inode_write(OpContext *ctx, Inode *inode, u8 *src, usize offset, usize count) {
-    InodeEntry *entry = &inode->entry;
+static bool write_blocks(OpContext *ctx, Inode *inode, u8 *src, usize offset, usize count) {
     usize end = offset + count;
-    assert(offset <= entry->num_bytes);
-    assert(end <= INODE_MAX_BYTES);
-    assert(offset <= end);
 
     // define some values.
     bool modify = false;
@@ -476,7 +577,7 @@ static void inode_write(OpContext *ctx, Inode *inode, u8 *src, usize offset, usi
     usize start, term;
 
     // begin writing.
-    while(i <= end) {
+    while(i < end) {
         // i: data block_no.
         // copydata start from start, ends at term in this block.
         start = MAX(i, offset)-i;
@@ -487,13 +588,34 @@ static void inode_write(OpContext *ctx, Inode *inode, u8 *src, usize offset, usi
         
         // begin copying to disk.
         Block *block = cache->acquire(block_no);
-        memcpy((u8 *)block + start, src, term-start);
+        memcpy(block->data + start, src, term-start);
+        cache->sync(ctx, block);
         cache->release(block);
 
         // update terminal and start.
         src += term-start;
         i += BLOCK_SIZE;
     }
+    return modify;
+}
+
+// see `inode.h`.
+static void inode_write(OpContext *ctx, Inode *inode, u8 *src, usize offset, usize count) {
+    InodeEntry *entry = &inode->entry;
+    usize end = offset + count;
+    assert(offset <= entry->num_bytes);
+    assert(end <= INODE_MAX_BYTES);
+    assert(offset <= end);
+
+    bool modify = write_blocks(ctx, inode, src, offset, count);
+
+    // keep cached pages in step with the blocks.
+    for (usize i = round_down(offset, FILE_PAGE_SIZE); i < end; i += FILE_PAGE_SIZE) {
+        u8 *page = inode->pages[i / FILE_PAGE_SIZE];
+        usize start = MAX(i, offset), term = MIN(i + FILE_PAGE_SIZE, end);
+        if (page)
+            memcpy(page + (start - i), src + (start - offset), term - start);
+    }
     
     // update number of bytes of the entry.
     if (modify || entry->num_bytes < end) {
@@ -502,6 +624,19 @@ static void inode_write(OpContext *ctx, Inode *inode, u8 *src, usize offset, usi
     }
 }
 
+// see `inode.h`.
+static void inode_sync_page(OpContext *ctx, Inode *inode, usize index) {
+    InodeEntry *entry = &inode->entry;
+    usize offset = index * FILE_PAGE_SIZE;
+    assert(entry->type == INODE_REGULAR);
+    assert(index < INODE_MAX_PAGES);
+
+    if (inode->pages[index] && offset < entry->num_bytes) {
+        usize count = MIN((usize)FILE_PAGE_SIZE, entry->num_bytes - offset);
+        write_blocks(ctx, inode, inode->pages[index], offset, count);
+    }
+}
+
 //
 // see `inode.h`.
 // caller holding the lock so `inode_lookup` does not hold any lock.
@@ -623,6 +758,8 @@ InodeTree inodes = {
     .put = inode_put,
     .read = inode_read,
     .write = inode_write,
+    .get_page = inode_get_page,
+    .sync_page = inode_sync_page,
     .lookup = inode_lookup,
     .insert = inode_insert,
     .remove = inode_remove,
@@ -3,11 +3,18 @@
 #include <common/list.h>
 #include <common/rc.h>
 #include <common/spinlock.h>
+#include <core/mutex.h>
+#include <core/rcu.h>
 #include <fs/cache.h>
 #include <fs/defines.h>
 
 #define ROOT_INODE_NO 1
 
+// file pages are physical pages, so that they can be mapped directly.
+#define FILE_PAGE_SIZE  4096
+#define BLOCKS_PER_PAGE (FILE_PAGE_SIZE / BLOCK_SIZE)
+#define INODE_MAX_PAGES ((INODE_MAX_BYTES + FILE_PAGE_SIZE - 1) / FILE_PAGE_SIZE)
+
 struct InodeTree;
 
 typedef struct {
@@ -17,9 +24,14 @@ typedef struct {
     ListNode node;
     usize inode_no;
     RefCount rc;
-    SpinLock lock;
+    Mutex lock;
     bool valid;        // is `entry` loaded? if `valid` is false, meaning content of this inode is not loaded.
     InodeEntry entry;  // real inode data on the disk.
+
+    // page cache of a regular file. NULL if the page is not loaded.
+    void *pages[INODE_MAX_PAGES];
+
+    RcuHead rcu;  // a put inode is freed after a grace period.
 } Inode;
 
 typedef struct InodeTree {
@@ -70,15 +82,37 @@ typedef struct InodeTree {
     void (*put)(OpContext *ctx, Inode *inode);
 
     // read exactly `count` bytes from `inode`, beginning at `offset`, to `dest`.
+    // regular files are read through the page cache.
     //
     // NOTE: caller must hold the lock of `inode`.
     void (*read)(Inode *inode, u8 *dest, usize offset, usize count);
 
     // write exactly `count` bytes from `src` to `inode`, beginning at `offset`.
+    // the blocks are written through the block cache, and cached pages are
+    // updated in place.
     //
     // NOTE: caller must hold the lock of `inode`.
     void (*write)(OpContext *ctx, Inode *inode, u8 *src, usize offset, usize count);
 
+    // for regular file inode only.
+    //
+    // return page `index` of `inode` from the page cache, loading it with one
+    // `read_blocks` if necessary, and take a reference to it for the caller
+    // (see `kref`). Bytes beyond the end of the file read as zeros.
+    // return NULL if the page starts beyond the end of the file.
+    //
+    // NOTE: caller must hold the lock of `inode`.
+    void *(*get_page)(Inode *inode, usize index);
+
+    // for regular file inode only.
+    //
+    // write the cached page `index` of `inode` back to its blocks, e.g. after
+    // it is modified through a mapping. Bytes beyond the end of the file and
+    // pages not in the cache are not written.
+    //
+    // NOTE: caller must hold the lock of `inode`.
+    void (*sync_page)(OpContext *ctx, Inode *inode, usize index);
+
     // for directory inode only.
     //
     // look up `name` in directory `inode`.
@@ -1,4 +1,5 @@
 extern "C" {
+#include <core/rcu.h>
 #include <fs/cache.h>
 }
 
@@ -347,6 +348,33 @@ void test_global_absorption() {
 
 // target: replay at initialization.
 
+// a commit writes every logged block twice and the header twice, and reads
+// nothing back.
+void test_commit_writes() {
+    initialize(32, 64);
+
+    OpContext ctx;
+    bcache.begin_op(&ctx);
+    usize t = sblock.num_blocks - 1;
+    for (usize j = 0; j < OP_MAX_NUM_BLOCKS; j++) {
+        auto *b = bcache.acquire(t - j);
+        b->data[0] = static_cast<u8>(j);
+        bcache.sync(&ctx, b);
+        bcache.release(b);
+    }
+
+    usize num_reads = mock.read_count, num_writes = mock.write_count;
+    bcache.end_op(&ctx);
+    assert_eq(mock.read_count, num_reads);
+    assert_eq(mock.write_count, num_writes + 2 * OP_MAX_NUM_BLOCKS + 2);
+
+    assert_eq(mock.inspect_log_header()->num_blocks, 0);
+    for (usize j = 0; j < OP_MAX_NUM_BLOCKS; j++) {
+        assert_eq(mock.inspect(t - j)[0], j);
+        assert_eq(mock.inspect_log(j)[0], j);
+    }
+}
+
 void test_replay() {
     initialize_mock(50, 1000);
 
@@ -599,6 +627,65 @@ void test_alloc() {
     assert_true(bno.back() < sblock.num_blocks);
 }
 
+// cached blocks are acquired without the lock of the block cache while
+// other blocks are evicted and loaded again. Report the throughput.
+void test_lookup() {
+    constexpr usize num_workers = 4;
+    constexpr usize num_lookups = 200000;
+    constexpr usize num_candidates = 2 * EVICTION_THRESHOLD;
+
+    initialize(1, num_candidates);
+    usize last = sblock.num_blocks - 1;
+    for (usize i = 0; i < EVICTION_THRESHOLD; i++) {
+        bcache.release(bcache.acquire(last - i));
+    }
+
+    std::atomic<bool> started = false, stopped = false;
+    std::vector<std::thread> workers;
+    for (usize i = 0; i < num_workers; i++) {
+        workers.emplace_back([&, i] {
+            std::mt19937 gen(i);
+            while (!started) {
+                std::this_thread::yield();
+            }
+
+            for (usize j = 0; j < num_lookups; j++) {
+                usize t = last - gen() % num_candidates;
+                auto *b = bcache.acquire(t);
+                assert_eq(b->block_no, t);
+                bcache.release(b);
+            }
+        });
+    }
+
+    std::thread evictor([&] {
+        std::mt19937 gen(0x19260817);
+        while (!stopped) {
+            bcache.release(bcache.acquire(last - gen() % num_candidates));
+        }
+    });
+
+    usize num_reads = mock.read_count;
+    auto t0 = std::chrono::steady_clock::now();
+    started = true;
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    num_reads = mock.read_count - num_reads;
+    stopped = true;
+    evictor.join();
+
+    // no thread holds a pointer found under RCU any more.
+    rcu_poll();
+
+    double seconds = std::chrono::duration<double>(t1 - t0).count();
+    printf("(trace) %zu threads: %.2f M acquires/s, %zu device reads\n",
+           num_workers,
+           num_workers * num_lookups / seconds / 1e6,
+           num_reads);
+}
+
 }  // namespace concurrent
 
 namespace crash {
@@ -886,6 +973,7 @@ int main() {
         {"resident", basic::test_resident},
         {"local_absorption", basic::test_local_absorption},
         {"global_absorption", basic::test_global_absorption},
+        {"commit_writes", basic::test_commit_writes},
         {"replay", basic::test_replay},
         {"alloc", basic::test_alloc},
         {"alloc_free", basic::test_alloc_free},
@@ -893,6 +981,7 @@ int main() {
         {"concurrent_acquire", concurrent::test_acquire},
         {"concurrent_sync", concurrent::test_sync},
         {"concurrent_alloc", concurrent::test_alloc},
+        {"concurrent_lookup", concurrent::test_lookup},
 
         {"simple_crash", crash::test_simple_crash},
         {"single", [] { crash::test_parallel(1000, 1, 5, 0); }},
@@ -1,4 +1,6 @@
 extern "C" {
+#include <core/physical_memory.h>
+#include <fs/file_map.h>
 #include <fs/inode.h>
 }
 
@@ -223,6 +225,78 @@ void test_small_file() {
     assert_eq(mock.count_inodes(), 1);
 }
 
+void test_file_map() {
+    init_file_maps(&sblock, &cache);
+
+    mock.begin_op(ctx);
+    usize ino = inodes.alloc(ctx, INODE_REGULAR);
+    mock.end_op(ctx);
+
+    constexpr usize size = FILE_PAGE_SIZE + 100;
+    u8 buf[size];
+    for (usize i = 0; i < size; i++) {
+        buf[i] = i & 0xff;
+    }
+
+    auto *p = inodes.get(ino);
+    inodes.lock(p);
+    mock.begin_op(ctx);
+    inodes.write(ctx, p, buf, 0, size);
+    mock.end_op(ctx);
+    inodes.unlock(p);
+
+    // mappings of one file share its pages.
+    FileMap *m1 = file_map_get(ino), *m2 = file_map_get(ino);
+    assert_eq(m1, m2);
+    assert_eq(file_map_get(ROOT_INODE_NO), nullptr);
+    assert_eq(file_map_get(0), nullptr);
+    assert_eq(file_map_get(sblock.num_inodes), nullptr);
+
+    u8 *page0 = reinterpret_cast<u8 *>(file_map_page(m1, 0));
+    u8 *page1 = reinterpret_cast<u8 *>(file_map_page(m1, 1));
+    assert_eq(file_map_page(m2, 0), page0);
+    assert_eq(file_map_page(m1, 2), nullptr);
+    for (usize i = 0; i < FILE_PAGE_SIZE; i++) {
+        assert_eq(page0[i], buf[i]);
+    }
+    for (usize i = 0; i < FILE_PAGE_SIZE; i++) {
+        assert_eq(page1[i], i < 100 ? buf[FILE_PAGE_SIZE + i] : 0);
+    }
+
+    // dirty pages are written back, but not past the end of the file.
+    page1[0] = 0xcc;
+    page1[200] = 0xdd;
+    file_map_set_dirty(m1, 1);
+    file_map_put(m1);
+
+    u8 copy[size + 1];
+    inodes.lock(p);
+    assert_eq(p->entry.num_bytes, size);
+    inodes.read(p, copy, 0, size);
+    inodes.unlock(p);
+    assert_eq(copy[FILE_PAGE_SIZE], 0xcc);
+    assert_eq(copy[FILE_PAGE_SIZE + 1], buf[FILE_PAGE_SIZE + 1]);
+
+    // mapped pages are the page cache, so writes show up in them.
+    u8 byte = 0xee;
+    inodes.lock(p);
+    mock.begin_op(ctx);
+    inodes.write(ctx, p, &byte, 10, 1);
+    mock.end_op(ctx);
+    inodes.unlock(p);
+    assert_eq(page0[10], 0xee);
+
+    // drop the references the "mappings" took.
+    kfree(page0);
+    kfree(page0);
+    kfree(page1);
+    file_map_put(m2);
+
+    mock.begin_op(ctx);
+    inodes.put(ctx, p);
+    mock.end_op(ctx);
+}
+
 void test_large_file() {
     mock.begin_op(ctx);
     usize ino = inodes.alloc(ctx, INODE_REGULAR);
@@ -408,6 +482,7 @@ int main() {
         {"touch", adhoc::test_touch},
         {"share", adhoc::test_share},
         {"small_file", adhoc::test_small_file},
+        {"file_map", adhoc::test_file_map},
         {"large_file", adhoc::test_large_file},
         {"dir", adhoc::test_dir},
     };
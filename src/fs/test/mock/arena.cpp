@@ -4,9 +4,15 @@ extern "C" {
 
 #include "map.hpp"
 
+#include <mutex>
+#include <unordered_map>
+
 namespace {
 Map<struct Arena *, usize> map;
-Map<u8 *, u8 *> ref;
+
+// aligned page -> (allocated memory, number of references).
+std::mutex page_mutex;
+std::unordered_map<u8 *, std::pair<u8 *, usize>> pages;
 }  // namespace
 
 extern "C" {
@@ -21,12 +27,25 @@ void *kalloc() {
     usize i = reinterpret_cast<usize>(p);
     usize j = (i + 4095) / 4096 * 4096;
     u8 *q = reinterpret_cast<u8 *>(j);
-    ref.add(q, p);
+    std::lock_guard lock(page_mutex);
+    pages[q] = {p, 1};
     return q;
 }
 
+void kref(void *ptr) {
+    std::lock_guard lock(page_mutex);
+    pages.at(reinterpret_cast<u8 *>(ptr)).second++;
+}
+
 void kfree(void *ptr) {
-    free(ref[reinterpret_cast<u8 *>(ptr)]);
+    std::lock_guard lock(page_mutex);
+    auto it = pages.find(reinterpret_cast<u8 *>(ptr));
+    if (it == pages.end())
+        throw Internal("kfree: unknown page");
+    if (--it->second.second > 0)
+        return;
+    free(it->second.first);
+    pages.erase(it);
 }
 
 void init_arena(Arena *arena, usize object_size, ArenaPageAllocator allocator [[maybe_unused]]) {
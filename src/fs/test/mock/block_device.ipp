@@ -10,10 +10,22 @@ static void stub_read(usize block_no, u8 *buffer) {
     mock.read(block_no, buffer);
 }
 
+static void stub_read_blocks(usize block_no, usize num_blocks, u8 *buffer) {
+    for (usize i = 0; i < num_blocks; i++) {
+        mock.read(block_no + i, buffer + i * BLOCK_SIZE);
+    }
+}
+
 static void stub_write(usize block_no, u8 *buffer) {
     mock.write(block_no, buffer);
 }
 
+static void stub_write_blocks(usize block_no, usize num_blocks, u8 **buffers) {
+    for (usize i = 0; i < num_blocks; i++) {
+        mock.write(block_no + i, buffers[i]);
+    }
+}
+
 static void initialize_mock(  //
     usize log_size,
     usize num_data_blocks,
@@ -30,7 +42,9 @@ static void initialize_mock(  //
     mock.initialize(sblock);
 
     device.read = stub_read;
+    device.read_blocks = stub_read_blocks;
     device.write = stub_write;
+    device.write_blocks = stub_write_blocks;
 
     if (!image_path.empty())
         mock.load(image_path);
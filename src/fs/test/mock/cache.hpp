@@ -4,6 +4,7 @@ extern "C" {
 #include <fs/inode.h>
 }
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
@@ -46,9 +47,14 @@ struct MockBlockCache {
         usize index;
         std::mutex mutex;
         Block block;
+        u8 payload[BLOCK_SIZE];
+
+        Cell() {
+            block.data = payload;
+        }
 
         auto operator=(const Cell &rhs) -> Cell & {
-            block = rhs.block;
+            std::copy(rhs.payload, rhs.payload + BLOCK_SIZE, payload);
             return *this;
         }
 
@@ -326,6 +332,14 @@ struct MockBlockCache {
         p->mutex.unlock();
     }
 
+    void read_blocks(const usize *block_nos, usize num_blocks, u8 *buffer) {
+        for (usize i = 0; i < num_blocks; i++) {
+            auto *b = acquire(block_nos[i]);
+            std::copy(b->data, b->data + BLOCK_SIZE, buffer + i * BLOCK_SIZE);
+            release(b);
+        }
+    }
+
     void sync(OpContext *ctx, Block *b) {
         auto *p = check_and_get_cell(b);
         usize i = p->index;
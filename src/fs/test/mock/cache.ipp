@@ -30,6 +30,10 @@ static void stub_release(Block *block) {
     return mock.release(block);
 }
 
+static void stub_read_blocks(const usize *block_nos, usize num_blocks, u8 *buffer) {
+    mock.read_blocks(block_nos, num_blocks, buffer);
+}
+
 static void stub_sync(OpContext *ctx, Block *block) {
     mock.sync(ctx, block);
 }
@@ -44,6 +48,7 @@ static struct _Loader {
         cache.free = stub_free;
         cache.acquire = stub_acquire;
         cache.release = stub_release;
+        cache.read_blocks = stub_read_blocks;
         cache.sync = stub_sync;
     }
 } _loader;
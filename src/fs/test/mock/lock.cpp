@@ -5,7 +5,7 @@
 
 namespace {
 
-struct Mutex {
+struct Lock {
     bool locked;
     std::mutex mutex;
 
@@ -29,8 +29,10 @@ struct Signal {
     }
 };
 
-Map<void *, Mutex> mtx_map;
-Map<void *, Signal> sig_map;
+// never destroyed: detached test threads may still use them while the
+// process exits.
+Map<void *, Lock> &mtx_map = *new Map<void *, Lock>;
+Map<void *, Signal> &sig_map = *new Map<void *, Signal>;
 
 }  // namespace
 
@@ -63,6 +65,30 @@ void release_sleeplock(struct SleepLock *lock) {
     mtx_map[lock].unlock();
 }
 
+void init_mutex(struct Mutex *mutex, const char *name [[maybe_unused]]) {
+    mtx_map.try_add(mutex);
+}
+
+bool try_acquire_mutex(struct Mutex *mutex) {
+    auto &m = mtx_map[mutex];
+    if (!m.mutex.try_lock())
+        return false;
+    m.locked = true;
+    return true;
+}
+
+void acquire_mutex(struct Mutex *mutex) {
+    mtx_map[mutex].lock();
+}
+
+void release_mutex(struct Mutex *mutex) {
+    mtx_map[mutex].unlock();
+}
+
+bool holding_mutex(struct Mutex *mutex) {
+    return mtx_map[mutex].locked;
+}
+
 void _fs_test_sleep(void *chan, struct SpinLock *lock) {
     sig_map.safe_get(chan).cv->wait(mtx_map[lock].mutex);
 }
@@ -0,0 +1,36 @@
+extern "C" {
+#include <core/rcu.h>
+}
+
+#include <mutex>
+#include <vector>
+
+namespace {
+std::mutex mutex;
+std::vector<RcuHead *> pending;
+}  // namespace
+
+// test threads report no quiescent states: callbacks wait for `rcu_poll`,
+// which tests call once no other thread can hold a pointer.
+extern "C" {
+void init_rcu() {}
+
+void rcu_quiescent() {}
+
+void call_rcu(RcuHead *head, void (*func)(RcuHead *head)) {
+    head->func = func;
+    std::unique_lock lock(mutex);
+    pending.push_back(head);
+}
+
+void rcu_poll() {
+    std::vector<RcuHead *> heads;
+    {
+        std::unique_lock lock(mutex);
+        heads.swap(pending);
+    }
+    for (auto *head : heads) {
+        head->func(head);
+    }
+}
+}
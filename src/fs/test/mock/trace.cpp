@@ -0,0 +1,9 @@
+extern "C" {
+#include <core/trace.h>
+}
+
+extern "C" {
+void trace_event(TraceEventType type [[maybe_unused]],
+                 u64 arg0 [[maybe_unused]],
+                 u64 arg1 [[maybe_unused]]) {}
+}
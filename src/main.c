@@ -3,16 +3,22 @@
 #include <core/arena.h>
 #include <core/console.h>
 #include <core/container.h>
+#include <core/mutex.h>
 #include <core/physical_memory.h>
 #include <core/proc.h>
+#include <core/profile.h>
+#include <core/rcu.h>
 #include <core/sched.h>
+#include <core/timer.h>
+#include <core/trace.h>
 #include <core/trap.h>
 #include <core/virtual_memory.h>
+#include <core/workqueue.h>
 #include <driver/clock.h>
 #include <driver/interrupt.h>
 #include <driver/sd.h>
 
-struct cpu cpus[NCPU];
+DEFINE_PER_CPU(struct cpu, cpus);
 
 static SpinLock init_lock = {.locked = 0};
 
@@ -30,11 +36,14 @@ void init_system_once() {
     init_sched();
 
     init_memory_manager();
+    init_rcu();
     init_virtual_memory();
 
     // vm_test();
     arena_test();
     init_container();
+    // mutex_test();
+    // trace_test();
     sd_init();
 
     release_spinlock(&init_lock);
@@ -42,12 +51,16 @@ void init_system_once() {
 
 void hello() {
     printf("CPU %d: HELLO!\n", cpuid());
+    // sched_dump_stats();
     reset_clock(1000);
     yield();
 }
 
 void init_system_per_cpu() {
     init_clock();
+    init_timers();
+    init_preemption();
+    init_workqueue();
     set_clock_handler(hello);
     init_trap();
 
@@ -58,18 +71,31 @@ void init_system_per_cpu() {
 
 NORETURN void main() {
 	/* : Lab1 print */
+    init_percpu();
     init_system_once();
     wait_spinlock(&init_lock);
 
     init_system_per_cpu();
 
     if (cpuid() == 0) {
+        // profile_start(PROFILE_DEFAULT_FREQUENCY);
+        // timer_test();
         spawn_init_process();
         // add_loop_test(1);
         // container_test_init();
         bound_processor_pid(1, 0);
         sd_init_idle();
+        spawn_sd_io_thread();
+        spawn_workers();
+        start_zeroed_refill();
         // add_sd_test();
+        // add_syscall_bench();
+        // add_pingpong_bench();
+        // add_fp_test();
+        // add_vdso_test();
+        // add_uring_test();
+        // add_pagefault_test();
+        // add_fork_test();
         enter_scheduler();
     } else {
         enter_scheduler();
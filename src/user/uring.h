@@ -0,0 +1,44 @@
+#pragma once
+
+#include <core/syscallno.h>
+#include <core/uring.h>
+
+/*
+ * Stubs for the syscall rings. `ring` holds `URING_BASE`, as returned by
+ * `SYS_myring_setup`. `t0` and `t1` are the numbers of two scratch
+ * registers, e.g. `9, 10` for x9 and x10.
+ */
+
+/* queue system call `sysnum` with the argument in `arg`, tagged with `tag`. */
+.macro uring_submit ring, sysnum, arg, tag, t0, t1
+    ldr     w\t0, [\ring, #URING_SQ_TAIL]
+    and     x\t1, x\t0, #(URING_SQ_SIZE - 1)
+    lsl     x\t1, x\t1, #6  /* URING_SQE_SIZE */
+    add     x\t1, x\t1, \ring
+    add     x\t1, x\t1, #URING_SQ_ENTRIES
+    mov     x\t0, #\sysnum
+    str     x\t0, [x\t1, #URING_SQE_SYSNUM]
+    str     \arg, [x\t1, #URING_SQE_ARGS]
+    str     \tag, [x\t1, #URING_SQE_USER_DATA]
+    ldr     w\t0, [\ring, #URING_SQ_TAIL]
+    add     w\t0, w\t0, #1
+    add     x\t1, \ring, #URING_SQ_TAIL
+    stlr    w\t0, [x\t1]
+.endm
+
+/* pop one completion into `result`, or branch to `empty`. */
+.macro uring_complete ring, result, empty, t0, t1
+    add     x\t1, \ring, #URING_CQ_TAIL
+    ldar    w\t1, [x\t1]
+    ldr     w\t0, [\ring, #URING_CQ_HEAD]
+    cmp     w\t0, w\t1
+    b.eq    \empty
+    and     x\t1, x\t0, #(URING_CQ_SIZE - 1)
+    lsl     x\t1, x\t1, #4  /* URING_CQE_SIZE */
+    add     x\t1, x\t1, \ring
+    add     x\t1, x\t1, #URING_CQ_ENTRIES
+    ldr     \result, [x\t1, #URING_CQE_RESULT]
+    add     w\t0, w\t0, #1
+    add     x\t1, \ring, #URING_CQ_HEAD
+    stlr    w\t0, [x\t1]
+.endm
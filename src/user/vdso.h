@@ -0,0 +1,28 @@
+#pragma once
+
+#include <core/vdso.h>
+
+/*
+ * Stubs to read the vdso page without a system call.
+ * Each macro loads one field into `reg`, using `tmp` as a scratch register.
+ */
+
+.macro vdso_counter_frequency reg, tmp
+    mov     \tmp, #VDSO_BASE
+    ldr     \reg, [\tmp, #VDSO_COUNTER_FREQUENCY]
+.endm
+
+.macro vdso_getpid reg, tmp
+    mov     \tmp, #VDSO_BASE
+    ldrsw   \reg, [\tmp, #VDSO_PID]
+.endm
+
+.macro vdso_getrootpid reg, tmp
+    mov     \tmp, #VDSO_BASE
+    ldrsw   \reg, [\tmp, #VDSO_ROOT_PID]
+.endm
+
+.macro vdso_getcontainerid reg, tmp
+    mov     \tmp, #VDSO_BASE
+    ldrsw   \reg, [\tmp, #VDSO_CONTAINER_ID]
+.endm